@@ -43,7 +43,16 @@ enum crypto_algo {
     AES_ECB,
     AES_CBC,
     AES_CTR,
-    AES_KEY_PREPARE
+    AES_KEY_PREPARE,
+    AES_GCM,            /* STM32F42x/F43x only */
+    AES_CCM             /* STM32F42x/F43x only */
+};
+
+enum crypto_phase {
+    GCM_CCM_INIT,
+    GCM_CCM_HEADER,
+    GCM_CCM_PAYLOAD,
+    GCM_CCM_FINAL
 };
 
 enum crypto_dir {
@@ -51,9 +60,42 @@ enum crypto_dir {
     DECRYPT
 };
 
+/*
+ * data swapping done by the Cryp data path between the FIFOs and the core:
+ * CRYP_DATATYPE_BYTES for byte streams (the default), CRYP_DATATYPE_WORDS
+ * for data already held as big endian words by the CPU
+ */
+enum crypto_datatype {
+    CRYP_DATATYPE_WORDS,
+    CRYP_DATATYPE_HALF_WORDS,
+    CRYP_DATATYPE_BYTES,
+    CRYP_DATATYPE_BITS
+};
+
 int cryp_map(void);
+/* -1 while references taken with cryp_map_get() are held */
 int cryp_unmap(void);
 
+/*
+ * Reference counted mapping (CRYP_MAP_VOLUNTARY). cryp_map_get() maps the
+ * device unless it is still mapped. When the last reference is put, the
+ * device is unmapped at once, or, with CONFIG_USR_DRV_CRYP_MAP_LINGER, left
+ * mapped until cryp_map_idle() is called after the linger delay (e.g. from
+ * the task main loop) or cryp_map_flush() is called.
+ */
+int cryp_map_get(void);
+int cryp_map_put(void);
+int cryp_map_idle(void);
+
+/* unmaps a lingering device now. -1 while references are held */
+int cryp_map_flush(void);
+
+/* true while the CRYP device is mapped */
+bool cryp_mapped(void);
+
+/* block size of the configured mode in bytes: 8 for (T)DES, 16 for AES */
+uint32_t cryp_block_size(void);
+
 /**
  * encrypt_no_dma - Encrypt/Decrypt data without DMA
  * @data_in: Address of the buffer where this function will read data. The
@@ -94,12 +136,43 @@ void soc_encrypt_no_dma(const uint8_t * data_in, uint8_t * data_out,
 
 void cryp_set_key(const uint8_t * key, enum crypto_key_len key_len);
 
+/*
+ * word-native key and IV material: words already in the key and IV registers
+ * format, most significant word first, written and read back without any
+ * byte swap
+ */
+void cryp_set_key_words(const uint32_t * key, enum crypto_key_len key_len);
+
+/*
+ * forget which key is held by the key registers, forcing the next cryp_init()
+ * with a key to reload (and prepare) it
+ */
+void cryp_key_invalidate(void);
+
+/*
+ * does the key registers still hold the injected key? True once
+ * cryp_init_injector() or cryp_init_user() has run, false as soon as this
+ * task loads a key of its own (cryp_init() with a key, cryp_set_key()...)
+ */
+bool cryp_key_injected(void);
+
 void cryp_set_iv(const uint8_t * iv, unsigned int iv_len);
 
 void cryp_get_iv(uint8_t * iv, unsigned int iv_len);
 
+void cryp_set_iv_words(const uint32_t * iv, unsigned int iv_len);
+
+void cryp_get_iv_words(uint32_t * iv, unsigned int iv_len);
+
+/* reload the IV between two messages, keeping the current configuration */
+void cryp_reload_iv(const uint8_t * iv, unsigned int iv_len);
+
+void cryp_reload_iv_words(const uint32_t * iv, unsigned int iv_len);
+
 void cryp_enable_dma(void);
 
+void cryp_disable_dma(void);
+
 void enable_crypt(void);
 
 /**
@@ -116,7 +189,13 @@ void enable_crypt(void);
  * This function should be called before calling encrypt_dma or encrypt_no_dma.
  */
 
-void cryp_init_user(enum crypto_key_len key_len,
+/*
+ * The user role pins the device mapping as cryp_map() does: it is not
+ * unmapped by cryp_map_put()/cryp_map_idle(), only by cryp_unmap(). Returns
+ * -1 if the device can not be mapped, the engine being left untouched.
+ * @key_len is not used: the key size is the one set by the injector.
+ */
+int cryp_init_user(enum crypto_key_len key_len,
                const uint8_t * iv, unsigned int iv_len, enum crypto_algo mode, enum crypto_dir dir);
 
 void cryp_init_injector(const uint8_t * key, enum crypto_key_len key_len);
@@ -124,6 +203,16 @@ void cryp_init_injector(const uint8_t * key, enum crypto_key_len key_len);
 void cryp_init(const uint8_t * key, enum crypto_key_len key_len,
                const uint8_t * iv, unsigned int iv_len, enum crypto_algo mode, enum crypto_dir dir);
 
+/*
+ * same as cryp_init() (which uses CRYP_DATATYPE_BYTES and byte material),
+ * with the given data swapping, key and IV being word-native material (word
+ * aligned, see cryp_set_key_words()) when native is true
+ */
+void cryp_init_datatype(const uint8_t * key, enum crypto_key_len key_len,
+                        const uint8_t * iv, unsigned int iv_len,
+                        enum crypto_algo mode, enum crypto_dir dir,
+                        enum crypto_datatype datatype, bool native);
+
 /* initialize DMA streams for cryp (not runnable, should be reconf later) */
 int cryp_early_init(bool with_dma,
                      cryp_map_mode_t map_mode,
@@ -131,22 +220,414 @@ int cryp_early_init(bool with_dma,
                      int * dma_in_desc,
                      int * dma_out_desc);
 
-/* configure the DMA streams with proper informations (handlers, buffers...) */
+/*
+ * configure the DMA streams with proper informations (handlers, buffers...).
+ * Buffers larger than a DMA transfer are chained chunk by chunk from the
+ * handlers: if a chunk can not be handed to its stream, the transfer ends
+ * there and the handlers are called with CRYP_DMA_STATUS_ERROR set in status,
+ * the output buffer being incomplete.
+ */
+#define CRYP_DMA_STATUS_ERROR   0x80000000U
+
 int cryp_init_dma(user_dma_handler_t handler_in, user_dma_handler_t handler_out, int dma_in_desc,
                    int dma_out_desc);
 
 /*
- * start cryp with no DMA support
+ * start cryp with no DMA support. data_len is handled in whole blocks of the
+ * configured mode (see cryp_block_size()). data_out may be data_in (in place
+ * operation); partially overlapping buffers are refused (-1), here as with
+ * the interrupt driven and DMA transfers.
  */
 int cryp_do_no_dma(const uint8_t * data_in, uint8_t * data_out,
                     uint32_t data_len);
 
 /*
- * start cryp using DMA (this requires libdma)
+ * same as cryp_do_no_dma(), the output being discarded (CBC-MAC): the
+ * chaining value is then read back with cryp_get_iv()
+ */
+int cryp_absorb_no_dma(const uint8_t * data_in, uint32_t data_len);
+
+#if CONFIG_USR_DRV_CRYP_IRQ
+/*
+ * completion handler of the interrupt driven mode, executed in ISR context.
+ * status is 0 on success.
+ */
+typedef void (*cryp_async_handler_t)(int status);
+
+/*
+ * start cryp with no DMA support, without blocking: the FIFOs are serviced
+ * from the CRYP IRQ and handler is called when the whole buffer has been
+ * (de)crypted. Buffers must be word aligned and left untouched until then.
+ */
+int cryp_do_no_dma_async(const uint8_t * data_in, uint8_t * data_out,
+                         uint32_t data_len, cryp_async_handler_t handler);
+
+/* true while an interrupt driven transfer is running */
+bool cryp_async_busy(void);
+#endif
+
+/*
+ * start cryp using DMA (this requires libdma). bufout may be bufin: in place,
+ * the buffer is only complete once the output DMA handler has been called,
+ * the input one being called earlier.
  */
 int cryp_do_dma(const uint8_t * bufin, const uint8_t * bufout, uint32_t size,
                  int dma_in_desc, int dma_out_desc);
 
+/*
+ * largest amount of data a single DMA stream configuration can move, rounded
+ * down to the AES block size. Bigger buffers are transparently split in chunks
+ * by cryp_do_dma()/cryp_dma_launch() (this requires the DMA handlers to be set
+ * with cryp_init_dma()), the handlers being called once for the whole buffer.
+ */
+#define CRYP_DMA_MAX_SIZE   0xfff0
+
+/*
+ * Buffers the DMA can not use directly (not word aligned, or in the CCM data
+ * RAM) are bounced through a static area of CONFIG_USR_DRV_CRYP_BOUNCE_SIZE
+ * bytes, in chunks of a quarter of this size (this also requires the DMA
+ * handlers to be set with cryp_init_dma()). Without this area, these
+ * buffers are refused.
+ */
+
+/*
+ * prepare once, launch many: cryp_dma_prepare() builds the CRYP DMA streams
+ * descriptors for the given DMA descriptors, then each cryp_dma_launch() only
+ * reconfigures the buffer addresses and/or size that changed since the
+ * previous transfer, or reloads the streams as is when nothing changed.
+ * cryp_do_dma() is cryp_dma_prepare() + cryp_dma_launch().
+ */
+int cryp_dma_prepare(int dma_in_desc, int dma_out_desc);
+
+int cryp_dma_launch(const uint8_t * bufin, const uint8_t * bufout, uint32_t size);
+
+/* input stream only, completion reported by the input DMA handler */
+int cryp_dma_launch_in(const uint8_t * bufin, uint32_t size);
+
+/*
+ * ping-pong DMA streaming: buffers pushed with cryp_stream_push() are
+ * (de)crypted back to back, the next transfer being started from the output
+ * DMA completion of the previous one. handler is called (in ISR context) for
+ * each buffer once its output has been written, with status 0, or -1 if the
+ * buffer has been dropped. cryp_stream_init() installs its own DMA handlers.
+ */
+#define CRYP_STREAM_DEPTH 4
+
+typedef void (*cryp_stream_handler_t)(int status, const uint8_t * bufin,
+                                      uint8_t * bufout, uint32_t size);
+
+int cryp_stream_init(int dma_in_desc, int dma_out_desc,
+                     cryp_stream_handler_t handler);
+
+/* returns -1 if CRYP_STREAM_DEPTH buffers are already pending */
+int cryp_stream_push(const uint8_t * bufin, uint8_t * bufout, uint32_t size);
+
+uint32_t cryp_stream_pending(void);
+
+/*
+ * asynchronous job queue: each job carries its own configuration and
+ * buffers. Jobs are chained back to back from the output DMA completion, the
+ * Cryp engine being reprogrammed only when the configuration of the next job
+ * differs from the loaded one (the IV only is reloaded otherwise).
+ * The job handler is called in ISR context, the job it receives is only
+ * valid during the call. cryp_queue_init() installs its own DMA handlers.
+ */
+#define CRYP_QUEUE_DEPTH 8
+
+struct cryp_job;
+
+typedef void (*cryp_job_handler_t)(int status, const struct cryp_job * job);
+
+typedef struct cryp_job {
+    const uint8_t *     key;        /* NULL: use the loaded/injected key */
+    enum crypto_key_len key_len;
+    const uint8_t *     iv;         /* NULL: continue from the current IV */
+    unsigned int        iv_len;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    const uint8_t *     bufin;
+    uint8_t *           bufout;
+    uint32_t            size;
+    cryp_job_handler_t  handler;
+    void *              data;       /* caller private data */
+} cryp_job_t;
+
+int cryp_queue_init(int dma_in_desc, int dma_out_desc);
+
+/*
+ * the job is copied. Returns -1 if CRYP_QUEUE_DEPTH jobs are already pending.
+ * If the engine is owned when the queue is idle, the first job is started
+ * at the next cryp_release().
+ */
+int cryp_queue_submit(const cryp_job_t * job);
+
+uint32_t cryp_queue_pending(void);
+
+/* force a full reconfiguration for the next job (e.g. key changed in place) */
+void cryp_queue_invalidate(void);
+
+/*
+ * scatter-gather (de)cryption: the input and output segment lists may be
+ * split differently, and segments may be of any length and alignment, but
+ * both lists must hold the same number of bytes, multiple of the block
+ * size. Chained modes continue across segment boundaries. Blocks straddling
+ * a boundary are gathered in a local block, nothing else is copied.
+ */
+typedef struct {
+    uint8_t *   base;
+    uint32_t    len;
+} cryp_iovec_t;
+
+int cryp_do_sg_no_dma(const cryp_iovec_t * in, uint32_t in_cnt,
+                      const cryp_iovec_t * out, uint32_t out_cnt);
+
+/* status is 0 on success. Called in ISR context */
+typedef void (*cryp_sg_handler_t)(int status);
+
+/* installs its own DMA handlers, replacing the ones given to cryp_init_dma() */
+int cryp_sg_init(int dma_in_desc, int dma_out_desc, cryp_sg_handler_t handler);
+
+/*
+ * the segment lists (and buffers) must stay valid until the handler call.
+ * Returns -1 if the lists can't be started, the handler not being called;
+ * otherwise the handler is called once, before returning if no DMA transfer
+ * is needed at all
+ */
+int cryp_do_sg_dma(const cryp_iovec_t * in, uint32_t in_cnt,
+                   const cryp_iovec_t * out, uint32_t out_cnt);
+
+bool cryp_sg_busy(void);
+
+/*
+ * sessions: each session owns a key (NULL for the injected key), mode,
+ * direction and live IV. cryp_session_resume() saves the IV of the active
+ * session and loads the given one, skipping the key loading and preparation,
+ * and the mode/direction programming, when already done in the engine.
+ * Direct use of cryp_init()/cryp_init_user() must be followed by
+ * cryp_session_invalidate().
+ */
+#define CRYP_MAX_SESSIONS 4
+
+typedef struct {
+    uint32_t switches;      /* cryp_session_resume() calls changing the session */
+    uint32_t key_loads;     /* full reconfigurations, key included */
+    uint32_t key_prepares;  /* AES decryption key preparations */
+    uint32_t reconfs;       /* mode/direction/IV reconfigurations, key kept */
+    uint32_t iv_loads;      /* IV only reloads */
+} cryp_session_stats_t;
+
+/* returns the session id, or -1 if no session is available */
+int cryp_session_open(const uint8_t * key, enum crypto_key_len key_len,
+                      const uint8_t * iv, unsigned int iv_len,
+                      enum crypto_algo mode, enum crypto_dir dir);
+
+int cryp_session_close(int sid);
+
+/*
+ * data swapping of the session (CRYP_DATATYPE_BYTES by default), and whether
+ * its key and IV, as given to cryp_session_open(), are word-native material
+ */
+int cryp_session_set_datatype(int sid, enum crypto_datatype datatype, bool native);
+
+int cryp_session_resume(int sid);
+
+/* active session id, -1 if none */
+int cryp_session_active(void);
+
+void cryp_session_invalidate(void);
+
+void cryp_session_get_stats(cryp_session_stats_t * stats);
+
+/*
+ * sector batches: a run of @count sectors of @sector_size bytes, starting at
+ * @lba, is (de)crypted with a single call. Each sector IV is derived from its
+ * sector number, and only the IV registers are reloaded between two sectors.
+ * The sectors are contiguous in both buffers.
+ *   - CRYP_SECTOR_IV_PLAIN: the sector number, 64 bits little endian, zero
+ *     padded to the IV length,
+ *   - CRYP_SECTOR_IV_ESSIV: the plain IV encrypted in AES ECB with the ESSIV
+ *     key (usually a hash of the data key), AES modes only. The IVs are
+ *     derived CRYP_SECTOR_IV_BATCH sectors at a time.
+ */
+enum cryp_sector_iv {
+    CRYP_SECTOR_IV_PLAIN,
+    CRYP_SECTOR_IV_ESSIV
+};
+
+#define CRYP_SECTOR_IV_BATCH 32
+
+/* keys are not copied and must stay valid while sectors are processed */
+int cryp_sector_setup(const uint8_t * key, enum crypto_key_len key_len,
+                      enum crypto_algo mode, enum crypto_dir dir,
+                      enum cryp_sector_iv iv_gen,
+                      const uint8_t * essiv_key, enum crypto_key_len essiv_key_len);
+
+int cryp_do_sectors_no_dma(uint64_t lba, uint32_t sector_size, uint32_t count,
+                           const uint8_t * bufin, uint8_t * bufout);
+
+/* status is 0 on success, @count the number of sectors done. ISR context */
+typedef void (*cryp_sector_handler_t)(int status, uint64_t lba, uint32_t count);
+
+/* installs its own DMA handlers, replacing the ones given to cryp_init_dma() */
+int cryp_sector_init(int dma_in_desc, int dma_out_desc, cryp_sector_handler_t handler);
+
+int cryp_do_sectors_dma(uint64_t lba, uint32_t sector_size, uint32_t count,
+                        const uint8_t * bufin, uint8_t * bufout);
+
+bool cryp_sector_busy(void);
+
+/*
+ * AES-CTR streams: the counter block is handled on 128 bits (the hardware
+ * only increments its 32 least significant bits), updates may have any
+ * length (the unused keystream of the last block is kept for the next
+ * update), and cryp_ctr_seek() moves to any byte offset of the stream.
+ * The key is not copied (NULL for the key already in the engine).
+ */
+typedef struct {
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    uint8_t             iv[16];     /* counter block of the stream offset 0 */
+    uint64_t            offset;     /* current byte offset in the stream */
+    uint8_t             ks[16];     /* keystream of the block holding offset */
+    bool                ks_valid;
+} cryp_ctr_t;
+
+int cryp_ctr_init(cryp_ctr_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                  const uint8_t * iv);
+
+int cryp_ctr_update(cryp_ctr_t * ctx, const uint8_t * in, uint8_t * out, uint32_t len);
+
+int cryp_ctr_seek(cryp_ctr_t * ctx, uint64_t offset);
+
+/*
+ * AES MACs (CBC-MAC and CMAC, NIST SP 800-38B) on the AES-CBC path, the
+ * ciphertext being discarded. Updates may have any length: the last block is
+ * kept in the context until cryp_mac_final(), as CMAC handles it with its
+ * subkeys. CBC-MAC zero-pads a partial last block. The key is not copied
+ * (NULL for the key already in the engine).
+ */
+enum cryp_mac_type {
+    CRYP_MAC_CBC,
+    CRYP_MAC_CMAC
+};
+
+typedef struct {
+    enum cryp_mac_type  type;
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    uint8_t             k1[16];     /* CMAC subkeys */
+    uint8_t             k2[16];
+    uint8_t             chain[16];  /* CBC chaining value */
+    uint8_t             blk[16] __attribute__((aligned(4)));   /* pending block */
+    uint32_t            blk_len;
+} cryp_mac_t;
+
+int cryp_mac_init(cryp_mac_t * ctx, enum cryp_mac_type type,
+                  const uint8_t * key, enum crypto_key_len key_len);
+
+int cryp_mac_update(cryp_mac_t * ctx, const uint8_t * data, uint32_t len);
+
+/* writes the 16 bytes MAC */
+int cryp_mac_final(cryp_mac_t * ctx, uint8_t * mac);
+
+/*
+ * context swap: cryp_save_context() waits for the input to be processed and
+ * saves the engine state (including the GCM/CCM internal state), the output
+ * FIFO having been read back. cryp_restore_context() reloads it, along with
+ * the key (NULL if the key in place is the right one).
+ */
+typedef struct {
+    uint32_t cr;
+    uint32_t iv[4];
+    uint32_t csgcmccm[8];
+    uint32_t csgcm[8];
+} cryp_context_t;
+
+void cryp_save_context(cryp_context_t * ctx);
+
+void cryp_restore_context(const cryp_context_t * ctx,
+                          const uint8_t * key, enum crypto_key_len key_len);
+
+/*
+ * GCM/CCM phases, STM32F42x/F43x only. cryp_gcm_ccm_init() runs the init
+ * phase (@iv is the first counter block, @b0 the CCM B0 block), then
+ * cryp_gcm_ccm_phase() switches to the header and payload phases. Header
+ * blocks are fed with cryp_push_no_dma() (or cryp_dma_launch_in()), payload
+ * blocks with cryp_do_no_dma() (or cryp_dma_launch()), a last partial payload
+ * block with cryp_gcm_ccm_last_block(). cryp_gcm_ccm_final() outputs the tag.
+ */
+int cryp_gcm_ccm_init(const uint8_t * key, enum crypto_key_len key_len,
+                      const uint8_t * iv, enum crypto_algo mode, enum crypto_dir dir,
+                      const uint8_t * b0);
+
+void cryp_gcm_ccm_phase(enum crypto_phase phase);
+
+int cryp_push_no_dma(const uint8_t * data_in, uint32_t data_len);
+
+int cryp_gcm_ccm_last_block(const uint8_t * data_in, uint8_t * data_out, uint32_t data_len);
+
+int cryp_gcm_ccm_final(const uint8_t * block, uint8_t * tag);
+
+/*
+ * authenticated encryption (AES-GCM, AES-CCM), on top of the phases above.
+ * Header data may be given in chunks of any size. Payload chunks must be
+ * made of whole blocks, but the last one. CCM needs the header and payload
+ * lengths at init time, GCM ignores them and only supports 96 bits nonces.
+ * A message can be suspended between two calls, and resumed after any other
+ * use of the engine. The key is not copied (NULL for the key in place).
+ */
+typedef struct {
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    uint32_t            tag_len;
+    uint32_t            header_len;
+    uint32_t            payload_len;
+    uint32_t            header_done;
+    uint32_t            payload_done;
+    enum crypto_phase   phase;
+    bool                closed;         /* last partial payload block done */
+    bool                suspended;
+    uint8_t             ctr0[16] __attribute__((aligned(4)));  /* CCM counter block 0 */
+    uint8_t             blk[16] __attribute__((aligned(4)));   /* header bytes short of a block */
+    uint32_t            blk_len;
+    cryp_context_t      hw;             /* engine state while suspended */
+} cryp_aead_t;
+
+int cryp_aead_init(cryp_aead_t * ctx, enum crypto_algo mode, enum crypto_dir dir,
+                   const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * nonce, uint32_t nonce_len,
+                   uint32_t header_len, uint32_t payload_len, uint32_t tag_len);
+
+int cryp_aead_header(cryp_aead_t * ctx, const uint8_t * data, uint32_t len);
+
+int cryp_aead_payload(cryp_aead_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                      uint32_t len);
+
+/* outputs the tag_len bytes tag */
+int cryp_aead_final(cryp_aead_t * ctx, uint8_t * tag);
+
+/* same as cryp_aead_final(), but compares the tag in constant time */
+int cryp_aead_check(cryp_aead_t * ctx, const uint8_t * tag);
+
+int cryp_aead_suspend(cryp_aead_t * ctx);
+
+int cryp_aead_resume(cryp_aead_t * ctx);
+
+/* DMA: whole blocks, word aligned buffers. status is 0 on success, ISR context */
+typedef void (*cryp_aead_handler_t)(int status);
+
+/* installs its own DMA handlers, replacing the ones given to cryp_init_dma() */
+int cryp_aead_init_dma(int dma_in_desc, int dma_out_desc, cryp_aead_handler_t handler);
+
+int cryp_aead_header_dma(cryp_aead_t * ctx, const uint8_t * data, uint32_t len);
+
+int cryp_aead_payload_dma(cryp_aead_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                          uint32_t len);
+
+bool cryp_aead_busy(void);
+
 
 enum crypto_dir cryp_get_dir(void);
 
@@ -154,6 +635,217 @@ bool cryp_dir_switched(enum crypto_dir dir);
 
 void cryp_set_mode(enum crypto_algo mode);
 
+#if CONFIG_USR_DRV_CRYP_SOFT
+/*
+ * Software AES (ECB, CBC, CTR) and (T)DES (ECB, CBC), constant time and bit
+ * exact with the Cryp core. The key is expanded in the context, which must
+ * be wiped once done. (T)DES keys are given as for the Cryp core (K1 || K2
+ * || K3, the DES key being K1). cryp_soft_do() (de)crypts whole blocks
+ * (16 bytes for AES, 8 bytes for (T)DES), chaining from the previous call.
+ */
+typedef struct {
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    uint32_t            block;      /* block size, in bytes */
+    uint32_t            rounds;     /* AES rounds */
+    union {
+        uint8_t         aes[240];
+        uint64_t        des[3][16];
+    } rk;
+    uint8_t             iv[16];
+} cryp_soft_t;
+
+int cryp_soft_init(cryp_soft_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * iv, unsigned int iv_len,
+                   enum crypto_algo mode, enum crypto_dir dir);
+
+int cryp_soft_do(cryp_soft_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                 uint32_t data_len);
+
+void cryp_soft_get_iv(const cryp_soft_t * ctx, uint8_t * iv, unsigned int iv_len);
+
+void cryp_soft_wipe(cryp_soft_t * ctx);
+
+/*
+ * Dispatcher: each request goes to the Cryp core when it is mapped, not
+ * busy with an asynchronous transfer of this library, and the engine can be
+ * claimed (CRYP_PRIO_NORMAL, for the request only). When it is mapped out,
+ * requests up to CONFIG_USR_DRV_CRYP_SOFT_MAX bytes are done in software,
+ * bigger ones map the device for their duration. The chaining value is kept
+ * in the context, so that consecutive requests of a message may go to
+ * different backends.
+ */
+enum cryp_backend {
+    CRYP_BACKEND_NONE,
+    CRYP_BACKEND_HW,
+    CRYP_BACKEND_SOFT
+};
+
+typedef struct {
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    uint8_t             iv[16];
+    unsigned int        iv_len;
+    cryp_soft_t         soft;
+    bool                soft_ready;     /* software key schedule done */
+    enum cryp_backend   last;           /* backend of the last request */
+} cryp_auto_t;
+
+/* key may only be NULL (key already in the Cryp core) for hardware only use */
+int cryp_auto_init(cryp_auto_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * iv, unsigned int iv_len,
+                   enum crypto_algo mode, enum crypto_dir dir);
+
+int cryp_auto_do(cryp_auto_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                 uint32_t data_len);
+
+/* wipes the software key schedule */
+void cryp_auto_release(cryp_auto_t * ctx);
+#endif
+
+/*
+ * Engine ownership within the task. The token is taken and given back with
+ * a LDREX/STREX compare-and-swap, so that it can be claimed from the main
+ * thread as well as from the ISRs. A claim fails while the engine is owned,
+ * or while a claim of a higher class is pending, and is then left pending:
+ * the owner of a lower class may see it with cryp_claim_pending() at its
+ * next chunk boundary and release the engine early.
+ *
+ * The job queue runs under CRYP_PRIO_BULK and yields between two jobs. The
+ * ping-pong stream, scatter-gather and sector DMA transfers and AEAD DMA
+ * transfers own the engine as CRYP_PRIO_NORMAL while they run, and are
+ * refused while it is owned, as is the hardware path of the software
+ * dispatcher (which then falls back to software). CRYP_PRIO_URGENT is
+ * never taken by the driver, it is left to the application. The direct
+ * calls (cryp_init*(), cryp_do_no_dma(), cryp_do_dma() and the synchronous
+ * APIs built on them) do not claim the engine: they are what an owner uses,
+ * and must be bracketed by cryp_claim()/cryp_release() when any of the
+ * activities above may run.
+ */
+enum cryp_prio {
+    CRYP_PRIO_BULK,
+    CRYP_PRIO_NORMAL,
+    CRYP_PRIO_URGENT,
+    CRYP_PRIO_CLASSES
+};
+
+typedef void (*cryp_waiter_t)(void);
+
+/* 0 when the engine is owned, -1 otherwise (the claim being left pending) */
+int cryp_claim(enum cryp_prio prio);
+
+/* same as cryp_claim(), but no claim is left pending on failure */
+int cryp_claim_try(enum cryp_prio prio);
+
+/* withdraw a pending claim which will not be retried */
+void cryp_claim_cancel(enum cryp_prio prio);
+
+/* gives the engine back, then calls (once) the registered waiter */
+void cryp_release(void);
+
+/* true when a claim of a class higher than prio is pending */
+bool cryp_claim_pending(enum cryp_prio prio);
+
+/*
+ * waiter of the class prio, called once by a next cryp_release(), e.g. to
+ * resume a paused bulk activity. Each class has its own waiter: on release,
+ * they are called from the highest class down, until one of them has taken
+ * the engine. A waiter is called in the releasing context (task or ISR),
+ * and has to register itself again if its claim fails. Returns -1 if
+ * another waiter of the class is still registered. The CRYP_PRIO_BULK one
+ * is used by the job queue while it is paused.
+ */
+int cryp_claim_notify(enum cryp_prio prio, cryp_waiter_t waiter);
+
+/*
+ * Driver statistics. The phases and busy-waits below are instrumented in
+ * the driver; with CONFIG_USR_DRV_CRYP_STATS unset, the hooks compile to
+ * nothing and the query API is not available.
+ */
+enum cryp_stats_phase {
+    CRYP_STATS_INIT,            /* cryp_init*() as a whole */
+    CRYP_STATS_KEY_LOAD,
+    CRYP_STATS_KEY_PREPARE,
+    CRYP_STATS_IV_LOAD,
+    CRYP_STATS_DMA_CONFIG,      /* DMA stream (re)configuration syscall */
+    CRYP_STATS_TRANSFER,        /* direct access loop, or DMA launch to completion */
+    CRYP_STATS_DRAIN,           /* wait for the core after the last block */
+    CRYP_STATS_PHASES
+};
+
+enum cryp_stats_wait {
+    CRYP_STATS_WAIT_CONFIG,     /* core busy while (re)configuring */
+    CRYP_STATS_WAIT_KEY_PREPARE,
+    CRYP_STATS_WAIT_FIFO,       /* direct access polls without FIFO progress */
+    CRYP_STATS_WAIT_DRAIN,
+    CRYP_STATS_WAITS
+};
+
+/* busy-wait histograms buckets: 0, 1, 2-3, 4-7, ... 64 polls and more */
+#define CRYP_STATS_BUCKETS      8
+
+#if CONFIG_USR_DRV_CRYP_STATS
+typedef struct {
+    uint32_t count;
+    uint32_t max;               /* cycles */
+    uint64_t cycles;
+} cryp_stats_phase_t;
+
+typedef struct {
+    cryp_stats_phase_t phase[CRYP_STATS_PHASES];
+    uint32_t           spins[CRYP_STATS_WAITS][CRYP_STATS_BUCKETS];
+    uint32_t           spins_max[CRYP_STATS_WAITS];
+    uint64_t           bytes[AES_CCM + 1][2];  /* per mode and direction */
+    cryp_stats_phase_t hold[CRYP_PRIO_CLASSES];    /* engine ownership */
+    uint32_t           contended[CRYP_PRIO_CLASSES];
+    uint32_t           map_ops;         /* cryp_map() and outer cryp_map_get() */
+    uint32_t           map_syscalls;    /* CFG_DEV_MAP/CFG_DEV_UNMAP issued */
+} cryp_stats_t;
+
+/* snapshot of the counters, not atomic with respect to the CRYP/DMA ISRs */
+void cryp_stats_get(cryp_stats_t * stats);
+
+void cryp_stats_reset(void);
+#endif
+
+#if CONFIG_USR_DRV_CRYP_TRACE
+/*
+ * Register access trace: every CRYP register access of the driver, and
+ * each chunk handed to a DMA stream, in a ring of
+ * CONFIG_USR_DRV_CRYP_TRACE_SIZE entries. Key registers values are never
+ * recorded, data and IV values only with CONFIG_USR_DRV_CRYP_TRACE_DATA
+ * (0 otherwise).
+ */
+enum cryp_trace_op {
+    CRYP_TRACE_READ,
+    CRYP_TRACE_WRITE,
+    CRYP_TRACE_DMA_IN,          /* value: chunk size given to the input stream */
+    CRYP_TRACE_DMA_OUT          /* value: chunk size given to the output stream */
+};
+
+typedef struct {
+    uint32_t stamp;             /* cycles, see CONFIG_USR_DRV_CRYP_STATS_DWT */
+    uint8_t  op;                /* enum cryp_trace_op */
+    uint8_t  reg;               /* register offset from the CRYP base */
+    uint16_t reserved;
+    uint32_t value;
+} cryp_trace_entry_t;
+
+void cryp_trace_enable(bool enable);
+
+/*
+ * moves up to max entries out of the ring, oldest first. Returns the number
+ * of entries copied, lost being set to the number of entries overwritten
+ * before having been dumped (may be NULL)
+ */
+uint32_t cryp_trace_dump(cryp_trace_entry_t * entries, uint32_t max, uint32_t * lost);
+
+/* dumps the whole ring as "stamp op reg value" hexadecimal lines */
+void cryp_trace_print(void);
+#endif
+
 void cryp_wait_for_emtpy_fifos(void);
 
 void cryp_flush_fifos(void);
@@ -1,11 +1,13 @@
 #include "api/libcryp.h"
 #include "cryp_regs.h"
+#include "cryp_stats.h"
 #include "libc/regutils.h"
 #include "libc/syscall.h"
 #include "libc/stdio.h"
 #include "libc/nostd.h"
 #include "libc/string.h"
 #include "libc/arpa/inet.h"
+#include "cryp_trace.h"
 
 #define CONFIG_USR_DRV_CRYP_DEBUG 0
 
@@ -19,43 +21,119 @@ static volatile bool cryp_is_mapped = false;
 
 static volatile int      dev_cryp_desc = 0;
 
-int cryp_map(void)
+/* control register shadow, see cryp_cr_commit() */
+static uint32_t cryp_cr_shadow = 0;
+static bool cryp_cr_shadow_valid = false;
+
+static inline void cryp_cr_resync(void)
+{
+    cryp_cr_shadow_valid = false;
+}
+
+/*
+ * Key currently held by the key registers, and whether AES_KEY_PREPARE has
+ * already turned it into its decryption form. cryp_init() uses it to skip
+ * reloading and re-preparing a key that is already in place.
+ */
+static struct {
+    bool                valid;
+    bool                prepared;
+    bool                native;         /* key given as word-native material */
+    enum crypto_key_len key_len;
+    uint8_t             key[32];
+} cryp_key_cache = { false, false, false, KEY_128, { 0 } };
+
+/* the injector task runs first: its key is in place until this task loads one */
+static bool cryp_key_injected_held = true;
+
+bool cryp_key_injected(void)
+{
+    return cryp_key_injected_held;
+}
+
+void cryp_key_invalidate(void)
+{
+    memset(cryp_key_cache.key, 0, sizeof(cryp_key_cache.key));
+    cryp_key_cache.prepared = false;
+    cryp_key_cache.valid = false;
+}
+
+/* is @key in the key registers, in a form usable for @prepared? */
+static bool cryp_key_cached(const uint8_t * key, enum crypto_key_len key_len, bool prepared,
+                            bool native)
 {
-    if (cryp_is_mapped == false) {
+    if (!cryp_key_cache.valid || (cryp_key_cache.key_len != key_len) ||
+        (cryp_key_cache.native != native)) {
+        return false;
+    }
+    /* a raw key can still be prepared, a prepared one can't go back */
+    if (cryp_key_cache.prepared && !prepared) {
+        return false;
+    }
+    return memcmp(cryp_key_cache.key, key, 16 + (8 * key_len)) == 0;
+}
+
+/*
+ * Voluntary mapping. Each CFG_DEV_MAP/CFG_DEV_UNMAP is a syscall: the
+ * references taken with cryp_map_get() keep the device mapped between
+ * operations, and the last cryp_map_put() lets it linger mapped for
+ * CONFIG_USR_DRV_CRYP_MAP_LINGER ms, until cryp_map_idle() or
+ * cryp_map_flush() unmaps it. A device mapped with cryp_map() stays mapped
+ * until cryp_unmap().
+ */
+static bool     cryp_map_auto = false;
+static bool     cryp_map_pinned = false;   /* mapped by cryp_map() */
+static uint32_t cryp_map_refs = 0;
+#if CONFIG_USR_DRV_CRYP_MAP_LINGER
+static uint64_t cryp_map_idle_since = 0;
+#endif
+
+static int cryp_map_dev(void)
+{
+    uint8_t ret;
+
+    if (cryp_is_mapped) {
+        return 0;
+    }
 #if CONFIG_USR_DRV_CRYP_DEBUG
-        printf("Mapping cryp\n");
+    printf("Mapping cryp\n");
 #endif
-        uint8_t ret;
-        ret = sys_cfg(CFG_DEV_MAP, dev_cryp_desc);
-        cryp_is_mapped = true;
-        if (ret != SYS_E_DONE) {
+    ret = sys_cfg(CFG_DEV_MAP, dev_cryp_desc);
+    cryp_stats_map_syscall();
+    if (ret != SYS_E_DONE) {
 #if CONFIG_USR_DRV_CRYP_DEBUG
-            printf("Unable to map cryp!\n");
+        printf("Unable to map cryp!\n");
 #endif
-            goto err;
-        }
+        goto err;
     }
+    cryp_is_mapped = true;
+    /* the other task may have changed the engine configuration and key */
+    cryp_cr_resync();
+    cryp_key_invalidate();
 
     return 0;
 err:
     return -1;
 }
 
-int cryp_unmap(void)
+static int cryp_unmap_dev(void)
 {
-    if (cryp_is_mapped) {
+    uint8_t ret;
+
+    if (!cryp_is_mapped || cryp_map_auto || cryp_map_pinned) {
+        return 0;
+    }
 #if CONFIG_USR_DRV_CRYP_DEBUG
-        printf("Unmapping cryp\n");
+    printf("Unmapping cryp\n");
 #endif
-        uint8_t ret;
-        ret = sys_cfg(CFG_DEV_UNMAP, dev_cryp_desc);
-        cryp_is_mapped = false;
-        if (ret != SYS_E_DONE) {
+    ret = sys_cfg(CFG_DEV_UNMAP, dev_cryp_desc);
+    cryp_stats_map_syscall();
+    cryp_is_mapped = false;
+    if (ret != SYS_E_DONE) {
 #if CONFIG_USR_DRV_CRYP_DEBUG
-            printf("Unable to unmap cryp!\n");
+        printf("Unable to unmap cryp!\n");
 #endif
-            goto err;
-        }
+        goto err;
     }
 
     return 0;
@@ -63,27 +141,194 @@ err:
     return -1;
 }
 
+int cryp_map(void)
+{
+    cryp_stats_map_op();
+    if (cryp_map_dev()) {
+        return -1;
+    }
+    cryp_map_pinned = true;
+    return 0;
+}
+
+bool cryp_mapped(void)
+{
+    return cryp_is_mapped;
+}
+
+int cryp_unmap(void)
+{
+    if (cryp_map_refs > 0) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: cryp still referenced!\n");
+#endif
+        return -1;
+    }
+    cryp_map_pinned = false;
+    return cryp_unmap_dev();
+}
+
+int cryp_map_get(void)
+{
+    /* nested references belong to the same operation */
+    if (cryp_map_refs == 0) {
+        cryp_stats_map_op();
+    }
+    if (cryp_map_dev()) {
+        return -1;
+    }
+    cryp_map_refs++;
+    return 0;
+}
+
+int cryp_map_put(void)
+{
+    uint64_t now = 0;
+
+    if (cryp_map_refs == 0) {
+        return -1;
+    }
+    if (--cryp_map_refs > 0) {
+        return 0;
+    }
+#if CONFIG_USR_DRV_CRYP_MAP_LINGER
+    sys_get_systick(&now, PREC_MILLI);
+    cryp_map_idle_since = now;
+    return 0;
+#else
+    (void) now;
+    return cryp_unmap_dev();
+#endif
+}
+
+int cryp_map_idle(void)
+{
+    uint64_t now = 0;
+
+    if ((cryp_map_refs > 0) || !cryp_is_mapped) {
+        return 0;
+    }
+#if CONFIG_USR_DRV_CRYP_MAP_LINGER
+    sys_get_systick(&now, PREC_MILLI);
+    if ((now - cryp_map_idle_since) < CONFIG_USR_DRV_CRYP_MAP_LINGER) {
+        return 0;
+    }
+#else
+    (void) now;
+#endif
+    return cryp_unmap_dev();
+}
+
+int cryp_map_flush(void)
+{
+    if (cryp_map_refs > 0) {
+        return -1;
+    }
+    return cryp_unmap_dev();
+}
+
 
 static int is_busy(void)
 {
     return get_reg(r_CORTEX_M_CRYP_SR, CRYP_SR_BUSY);
 }
 
-void cryp_set_keylen(enum crypto_key_len  key_len)
+/* busy-wait for the core, the number of polls being accounted to @wait */
+static void cryp_spin_busy(enum cryp_stats_wait wait)
 {
+    uint32_t spins = 0;
 
-   while (is_busy()){
-       continue;
+    while (is_busy()) {
+        spins++;
     }
-    set_reg(r_CORTEX_M_CRYP_CR, key_len, CRYP_CR_KEYSIZE);
+    cryp_stats_spins(wait, spins);
 }
 
+/*
+ * Shadow of the control register. Every CR update goes through
+ * cryp_cr_commit(), which writes the whole register at once, and skips both
+ * the write and the busy poll when the hardware already holds the value.
+ * The shadow is reloaded from the hardware when another task may have
+ * touched the device (mapping, role initialization).
+ */
+#define cryp_cr_set(cr, VALUE, FIELD) \
+    (((cr) & ~FIELD##_Msk) | (((uint32_t)(VALUE) << FIELD##_Pos) & FIELD##_Msk))
+
+/* ALGOMODE[3] is apart from ALGOMODE[2:0]. Also resets the GCM/CCM phase */
+static inline uint32_t cryp_cr_set_algo(uint32_t cr, enum crypto_algo mode)
+{
+    cr = cryp_cr_set(cr, mode & 0x7, CRYP_CR_ALGOMODE);
+    cr = cryp_cr_set(cr, (mode >> 3) & 0x1, CRYP_CR_ALGOMODE3);
+    return cryp_cr_set(cr, CRYP_CR_GCM_CCMPH_INIT, CRYP_CR_GCM_CCMPH);
+}
 
-void cryp_set_iv(const uint8_t * iv, unsigned int iv_len)
+static uint32_t cryp_cr_get(void)
+{
+    if (!cryp_cr_shadow_valid) {
+        cryp_cr_shadow = read_reg_value(r_CORTEX_M_CRYP_CR) & ~CRYP_CR_FFLUSH_Msk;
+        cryp_cr_shadow_valid = true;
+    }
+    return cryp_cr_shadow;
+}
+
+/* FFLUSH is never kept in the shadow, so a flush request is always written */
+static void cryp_cr_commit(uint32_t cr)
 {
-    while (is_busy()){
-       continue;
+    uint32_t cur = cryp_cr_get();
+
+    if (cr == cur) {
+        return;
+    }
+    /* the configuration must not change under a running block */
+    if (cur & CRYP_CR_CRYPEN_Msk) {
+        cryp_spin_busy(CRYP_STATS_WAIT_CONFIG);
     }
+    write_reg_value(r_CORTEX_M_CRYP_CR, cr);
+    cryp_cr_shadow = cr & ~CRYP_CR_FFLUSH_Msk;
+}
+
+/* (T)DES blocks are 64 bits long, AES ones (GCM/CCM included) 128 bits */
+uint32_t cryp_block_size(void)
+{
+    uint32_t cr = cryp_cr_get();
+
+    if (!(cr & CRYP_CR_ALGOMODE3_Msk) &&
+        (((cr & CRYP_CR_ALGOMODE_Msk) >> CRYP_CR_ALGOMODE_Pos) <= CRYP_CR_ALGOMODE_DES_CBC)) {
+        return 8;
+    }
+    return 16;
+}
+
+/* the core can only be busy while enabled (or finishing its last block) */
+static void cryp_wait_idle(void)
+{
+    if (cryp_cr_get() & CRYP_CR_CRYPEN_Msk) {
+        cryp_spin_busy(CRYP_STATS_WAIT_CONFIG);
+    }
+}
+
+void cryp_set_keylen(enum crypto_key_len  key_len)
+{
+    if (key_len != cryp_key_cache.key_len) {
+        cryp_key_invalidate();
+    }
+    cryp_cr_commit(cryp_cr_set(cryp_cr_get(), key_len, CRYP_CR_KEYSIZE));
+}
+
+
+/*
+ * Key and IV material is either given as bytes, each word being converted
+ * to the register format, or as word-native material: words already in the
+ * register format, most significant word first, written as is.
+ */
+static inline uint32_t cryp_material_word(const uint8_t * p, bool native)
+{
+    return native ? *(const uint32_t *) p : htonl(*(const uint32_t *) p);
+}
+
+static void cryp_load_iv(const uint8_t * iv, unsigned int iv_len, bool native)
+{
+    cryp_wait_idle();
     if(iv == NULL){
        return;
     }
@@ -91,23 +336,25 @@ void cryp_set_iv(const uint8_t * iv, unsigned int iv_len)
     if((iv_len != 8) && (iv_len != 16)){
         return;
     }
-    write_reg_value(r_CORTEX_M_CRYP_IVxLR(0), htonl(*(const uint32_t *) iv));
+    cryp_stats_begin(CRYP_STATS_IV_LOAD);
+    write_reg_value(r_CORTEX_M_CRYP_IVxLR(0), cryp_material_word(iv, native));
     iv += 4;
-    write_reg_value(r_CORTEX_M_CRYP_IVxRR(0), htonl(*(const uint32_t *) iv));
+    write_reg_value(r_CORTEX_M_CRYP_IVxRR(0), cryp_material_word(iv, native));
     if(iv_len == 16){
         iv += 4;
-        write_reg_value(r_CORTEX_M_CRYP_IVxLR(1), htonl(*(const uint32_t *) iv));
+        write_reg_value(r_CORTEX_M_CRYP_IVxLR(1), cryp_material_word(iv, native));
         iv += 4;
-        write_reg_value(r_CORTEX_M_CRYP_IVxRR(1), htonl(*(const uint32_t *) iv));
+        write_reg_value(r_CORTEX_M_CRYP_IVxRR(1), cryp_material_word(iv, native));
         iv += 4;
     }
+    cryp_stats_end(CRYP_STATS_IV_LOAD);
 }
 
-void cryp_get_iv(uint8_t * iv, unsigned int iv_len)
+static void cryp_read_iv(uint8_t * iv, unsigned int iv_len, bool native)
 {
-    while (is_busy()){
-       continue;
-    }
+    uint32_t i;
+
+    cryp_wait_idle();
     if(iv == NULL){
        return;
     }
@@ -115,63 +362,68 @@ void cryp_get_iv(uint8_t * iv, unsigned int iv_len)
     if((iv_len != 8) && (iv_len != 16)){
         return;
     }
-    *(uint32_t *) iv = htonl(read_reg_value(r_CORTEX_M_CRYP_IVxLR(0)));
-    iv += 4;
-    *(uint32_t *) iv = htonl(read_reg_value(r_CORTEX_M_CRYP_IVxRR(0)));
-    if(iv_len == 16){
-        iv += 4;
-        *(uint32_t *) iv = htonl(read_reg_value(r_CORTEX_M_CRYP_IVxLR(1)));
-        iv += 4;
-        *(uint32_t *) iv = htonl(read_reg_value(r_CORTEX_M_CRYP_IVxRR(1)));
+    for (i = 0; i < iv_len / 4; i++) {
+        *(uint32_t *) iv = read_reg_value((i & 1) ? r_CORTEX_M_CRYP_IVxRR(i / 2) : r_CORTEX_M_CRYP_IVxLR(i / 2));
+        if (!native) {
+            *(uint32_t *) iv = htonl(*(uint32_t *) iv);
+        }
         iv += 4;
     }
 }
 
-static void cryp_set_datatype(uint8_t datatype)
+void cryp_set_iv(const uint8_t * iv, unsigned int iv_len)
 {
-   while (is_busy()){
-       continue;
-   }
-   set_reg(r_CORTEX_M_CRYP_CR, datatype, CRYP_CR_DATATYPE);
+    cryp_load_iv(iv, iv_len, false);
 }
 
-void cryp_set_mode(enum crypto_algo mode)
+void cryp_get_iv(uint8_t * iv, unsigned int iv_len)
 {
-   while (is_busy()){
-       continue;
-   }
-   set_reg(r_CORTEX_M_CRYP_CR, mode, CRYP_CR_ALGOMODE);
+    cryp_read_iv(iv, iv_len, false);
 }
 
-static void set_dir(enum crypto_dir dir)
+void cryp_set_iv_words(const uint32_t * iv, unsigned int iv_len)
 {
-   while (is_busy()){
-       continue;
-    }
-    set_reg(r_CORTEX_M_CRYP_CR, dir, CRYP_CR_ALGODIR);
+    cryp_load_iv((const uint8_t *) iv, iv_len, true);
+}
+
+void cryp_get_iv_words(uint32_t * iv, unsigned int iv_len)
+{
+    cryp_read_iv((uint8_t *) iv, iv_len, true);
+}
+
+void cryp_set_mode(enum crypto_algo mode)
+{
+    cryp_cr_commit(cryp_cr_set_algo(cryp_cr_get(), mode));
 }
 
 void enable_crypt(void)
 {
-    set_reg_bits(r_CORTEX_M_CRYP_CR, CRYP_CR_CRYPEN_Msk);
+    cryp_cr_commit(cryp_cr_get() | CRYP_CR_CRYPEN_Msk);
 }
 
 static void disable_crypt(void)
 {
-    clear_reg_bits(r_CORTEX_M_CRYP_CR, CRYP_CR_CRYPEN_Msk);
+    cryp_cr_commit(cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk);
 }
 
-void cryp_flush_fifos(void)
+void cryp_reload_iv(const uint8_t * iv, unsigned int iv_len)
+{
+    disable_crypt();
+    cryp_set_iv(iv, iv_len);
+    enable_crypt();
+}
+
+void cryp_reload_iv_words(const uint32_t * iv, unsigned int iv_len)
 {
-    set_reg(r_CORTEX_M_CRYP_CR, 1, CRYP_CR_FFLUSH);
-   while (is_busy()){
-       continue;
-   }
+    disable_crypt();
+    cryp_set_iv_words(iv, iv_len);
+    enable_crypt();
 }
 
-static int is_out_fifo_not_empty(void)
+void cryp_flush_fifos(void)
 {
-    return get_reg(r_CORTEX_M_CRYP_SR, CRYP_SR_OFNE);
+    cryp_cr_commit(cryp_cr_get() | CRYP_CR_FFLUSH_Msk);
+    cryp_spin_busy(CRYP_STATS_WAIT_CONFIG);
 }
 
 static int is_in_fifo_not_empty(void)
@@ -181,14 +433,12 @@ static int is_in_fifo_not_empty(void)
 
 void cryp_wait_for_emtpy_fifos(void)
 {
+    uint32_t spins = 0;
+
     while (get_reg_value(r_CORTEX_M_CRYP_SR, CRYP_SR_OFNE_Msk | CRYP_SR_IFEM_Msk, 0) != CRYP_SR_IFEM_Msk) {
-        continue;
+        spins++;
     }
-}
-
-static int is_in_fifo_not_full(void)
-{
-    return get_reg(r_CORTEX_M_CRYP_SR, CRYP_SR_IFNF);
+    cryp_stats_spins(CRYP_STATS_WAIT_DRAIN, spins);
 }
 
 void cryp_disable_dma(void)
@@ -206,44 +456,62 @@ void cryp_enable_dma(void)
 
 enum crypto_dir cryp_get_dir(void)
 {
-    return (enum crypto_dir)get_reg_value(r_CORTEX_M_CRYP_CR, CRYP_CR_ALGODIR_Msk, CRYP_CR_ALGODIR_Pos);
+    return (enum crypto_dir)((cryp_cr_get() & CRYP_CR_ALGODIR_Msk) >> CRYP_CR_ALGODIR_Pos);
 }
 
-void cryp_set_key(const uint8_t * key, enum crypto_key_len key_len)
+static void cryp_load_key(const uint8_t * key, enum crypto_key_len key_len, bool native)
 {
     if(key == NULL){
         return;
     }
-    set_reg(r_CORTEX_M_CRYP_CR, key_len, CRYP_CR_KEYSIZE);
+    cryp_stats_begin(CRYP_STATS_KEY_LOAD);
+    cryp_cr_commit(cryp_cr_set(cryp_cr_get(), key_len, CRYP_CR_KEYSIZE));
 
     key += (16 + (8 * key_len) - 4);
-    write_reg_value(r_CORTEX_M_CRYP_KxRR(3), htonl(*(const uint32_t *) key));
+    write_reg_value(r_CORTEX_M_CRYP_KxRR(3), cryp_material_word(key, native));
     key -= 4;
-    write_reg_value(r_CORTEX_M_CRYP_KxLR(3), htonl(*(const uint32_t *) key));
+    write_reg_value(r_CORTEX_M_CRYP_KxLR(3), cryp_material_word(key, native));
     key -= 4;
-    write_reg_value(r_CORTEX_M_CRYP_KxRR(2), htonl(*(const uint32_t *) key));
+    write_reg_value(r_CORTEX_M_CRYP_KxRR(2), cryp_material_word(key, native));
     key -= 4;
-    write_reg_value(r_CORTEX_M_CRYP_KxLR(2), htonl(*(const uint32_t *) key));
+    write_reg_value(r_CORTEX_M_CRYP_KxLR(2), cryp_material_word(key, native));
     key -= 4;
 
     if ((key_len == CRYP_CR_KEYSIZE_256) || (key_len == CRYP_CR_KEYSIZE_192)) {
-        write_reg_value(r_CORTEX_M_CRYP_KxRR(1), htonl(*(const uint32_t *) key));
+        write_reg_value(r_CORTEX_M_CRYP_KxRR(1), cryp_material_word(key, native));
         key -= 4;
-        write_reg_value(r_CORTEX_M_CRYP_KxLR(1), htonl(*(const uint32_t *) key));
+        write_reg_value(r_CORTEX_M_CRYP_KxLR(1), cryp_material_word(key, native));
         key -= 4;
     }
 
     if (key_len == CRYP_CR_KEYSIZE_256) {
-        write_reg_value(r_CORTEX_M_CRYP_KxRR(0), htonl(*(const uint32_t *) key));
+        write_reg_value(r_CORTEX_M_CRYP_KxRR(0), cryp_material_word(key, native));
         key -= 4;
-        write_reg_value(r_CORTEX_M_CRYP_KxLR(0), htonl(*(const uint32_t *) key));
+        write_reg_value(r_CORTEX_M_CRYP_KxLR(0), cryp_material_word(key, native));
         key -= 4;
     }
-    while (is_busy()){
-        continue;
-    }
+    key += 4;
+    memcpy(cryp_key_cache.key, key, 16 + (8 * key_len));
+    cryp_key_cache.key_len = key_len;
+    cryp_key_cache.native = native;
+    cryp_key_cache.prepared = false;
+    cryp_key_cache.valid = true;
+    cryp_key_injected_held = false;
+    cryp_wait_idle();
+    cryp_stats_end(CRYP_STATS_KEY_LOAD);
     return;
 }
+
+void cryp_set_key(const uint8_t * key, enum crypto_key_len key_len)
+{
+    cryp_load_key(key, key_len, false);
+}
+
+void cryp_set_key_words(const uint32_t * key, enum crypto_key_len key_len)
+{
+    cryp_load_key((const uint8_t *) key, key_len, true);
+}
+
 /*
 ** configure, in both CRYP_CFG & CRYP_USER mode. beware to
 ** set key to 0 in CRYP_USER mode (or it will lead to memory exception)
@@ -251,23 +519,28 @@ void cryp_set_key(const uint8_t * key, enum crypto_key_len key_len)
 
 void cryp_init_injector(const uint8_t * key, enum crypto_key_len key_len)
 {
-    if (!cryp_is_mapped) {
-        uint8_t ret;
-        ret = sys_cfg(CFG_DEV_MAP, dev_cryp_desc);
-        if (ret != SYS_E_DONE) {
-            printf("Unable to map cryp!\n");
-            goto err;
-        }
-        cryp_is_mapped = true;
+    uint32_t cr;
+
+    if (!cryp_is_mapped && cryp_map()) {
+        printf("Unable to map cryp!\n");
+        goto err;
     }
-    disable_crypt();
+    /* the user task may have changed the engine configuration and key */
+    cryp_cr_resync();
+    cryp_key_invalidate();
+    cr = cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk;
+    if (key) {
+        cr = cryp_cr_set(cr, key_len, CRYP_CR_KEYSIZE);
+    }
+    /* disable, configure and flush in a single write */
+    cryp_cr_commit(cr | CRYP_CR_FFLUSH_Msk);
 
     if (key) {
       cryp_set_key(key, key_len);
+      cryp_key_injected_held = true;
     }
 
-    enable_crypt();
-    cryp_flush_fifos();
+    cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
 err:
     return;
 }
@@ -281,129 +554,682 @@ bool cryp_dir_switched(enum crypto_dir dir)
     return false;
 }
 
-void cryp_init_user(enum crypto_key_len key_len __attribute__((unused)) /* TODO: to be removed */,
+int cryp_init_user(enum crypto_key_len key_len __attribute__((unused)),
                const uint8_t * iv, unsigned int iv_len, enum crypto_algo mode, enum crypto_dir dir)
 {
-    if (!cryp_is_mapped) {
-        sys_cfg(CFG_DEV_MAP, dev_cryp_desc);
+    uint32_t cr;
+
+    /*
+     * pinned as with cryp_map(): a still mapped (or lingering) device costs
+     * no syscall, but must not be unmapped by cryp_map_idle() from now on
+     */
+    if (cryp_map()) {
+        goto err;
     }
-    cryp_flush_fifos();
-    cryp_set_datatype(CRYP_CR_DATATYPE_BYTES);
-    cryp_set_mode(mode);
-    set_dir(dir);
+    cryp_stats_begin(CRYP_STATS_INIT);
+    /* the injector task may have changed the engine configuration and key */
+    cryp_cr_resync();
+    cryp_key_invalidate();
+    /* the user role is initialized once the injector has set its key */
+    cryp_key_injected_held = true;
+    cr = cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk;
+    cr = cryp_cr_set(cr, CRYP_CR_DATATYPE_BYTES, CRYP_CR_DATATYPE);
+    cr = cryp_cr_set_algo(cr, mode);
+    cr = cryp_cr_set(cr, dir, CRYP_CR_ALGODIR);
+    /* disable, configure and flush in a single write */
+    cryp_cr_commit(cr | CRYP_CR_FFLUSH_Msk);
 
     if (iv) {
-        disable_crypt();
         cryp_set_iv(iv, iv_len);
-        enable_crypt();
     }
 
-    enable_crypt();
-    cryp_flush_fifos();
-    return;
+    cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
+    cryp_stats_end(CRYP_STATS_INIT);
+    return 0;
+err:
+    return -1;
 }
 
 
 
-void cryp_init(const uint8_t * key, enum crypto_key_len key_len,
-               const uint8_t * iv, unsigned int iv_len, enum crypto_algo mode, enum crypto_dir dir)
+void cryp_init_datatype(const uint8_t * key, enum crypto_key_len key_len,
+                        const uint8_t * iv, unsigned int iv_len,
+                        enum crypto_algo mode, enum crypto_dir dir,
+                        enum crypto_datatype datatype, bool native)
 {
+    uint32_t cr;
+    /* AES ECB and CBC decryption work on the prepared form of the key */
+    bool needs_prepared = (dir == DECRYPT) && ((mode == AES_ECB) || (mode == AES_CBC));
+    bool load_key = key && !cryp_key_cached(key, key_len, needs_prepared, native);
+    /*
+     * Prepare the key when it is (re)loaded, or when the raw form of the
+     * last loaded key is in place. Without key and without knowledge of
+     * the key registers (injected key), nothing is prepared.
+     */
+    bool prepare = needs_prepared &&
+        (load_key || (cryp_key_cache.valid && !cryp_key_cache.prepared));
 
-    disable_crypt();
+    cryp_stats_begin(CRYP_STATS_INIT);
+    /* compose the whole target configuration, engine disabled */
+    cr = cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk;
+    if (key) {
+        cr = cryp_cr_set(cr, key_len, CRYP_CR_KEYSIZE);
+    }
+    cr = cryp_cr_set(cr, datatype, CRYP_CR_DATATYPE);
+    cr = cryp_cr_set(cr, dir, CRYP_CR_ALGODIR);
+    cr = cryp_cr_set_algo(cr, prepare ? AES_KEY_PREPARE : mode);
+
+    /* nothing to load and the engine already runs this configuration */
+    if (!load_key && !prepare && !iv && ((cr | CRYP_CR_CRYPEN_Msk) == cryp_cr_get()) &&
+        (get_reg_value(r_CORTEX_M_CRYP_SR, CRYP_SR_OFNE_Msk | CRYP_SR_IFEM_Msk, 0) == CRYP_SR_IFEM_Msk)) {
+        cryp_stats_end(CRYP_STATS_INIT);
+        return;
+    }
+
+    /* disable, configure and flush in a single write */
+    cryp_cr_commit(cr | CRYP_CR_FFLUSH_Msk);
 
-    // TODO check that the acknowledgement is effective in the buffer
-    // config
     if (iv) {
-        cryp_set_iv(iv, iv_len);
+        cryp_load_iv(iv, iv_len, native);
     }
-    if (key) {
-        cryp_set_key(key, key_len);
+    if (load_key) {
+        cryp_load_key(key, key_len, native);
     }
-    cryp_set_datatype(CRYP_CR_DATATYPE_BYTES);
-    set_dir(dir);
 
-    /* Prepare key when decryption is asked (except for CTR mode) */
-    if (key && (dir == DECRYPT) && (mode != AES_CTR)) {
-        cryp_set_mode(AES_KEY_PREPARE);
-        enable_crypt();
-        while (is_busy())
-            continue;
+    if (prepare) {
+        cryp_stats_begin(CRYP_STATS_KEY_PREPARE);
+        cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
+        cryp_spin_busy(CRYP_STATS_WAIT_KEY_PREPARE);
+        cryp_key_cache.prepared = true;
+        cr = cryp_cr_set_algo(cr, mode);
+        cryp_cr_commit(cr);
+        cryp_stats_end(CRYP_STATS_KEY_PREPARE);
     }
-    cryp_set_mode(mode);
 
-    enable_crypt();
-    cryp_flush_fifos();
+    cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
+    cryp_stats_end(CRYP_STATS_INIT);
     return;
 }
 
+void cryp_init(const uint8_t * key, enum crypto_key_len key_len,
+               const uint8_t * iv, unsigned int iv_len, enum crypto_algo mode, enum crypto_dir dir)
+{
+    cryp_init_datatype(key, key_len, iv, iv_len, mode, dir, CRYP_DATATYPE_BYTES, false);
+}
+
+/*
+ * The CRYP FIFOs are 8 words deep, and the core loads (resp. stores) whole
+ * blocks from the input FIFO (resp. into the output FIFO). As we always push
+ * and pop whole blocks, IFNF means that there is room for at least one block,
+ * IFEM that the whole FIFO is free (two AES blocks, four (T)DES blocks), and
+ * OFNE that at least one block is ready.
+ */
+#define CRYP_FIFO_WORDS         8
+#define CRYP_AES_BLOCK_WORDS    4
+
+/* direct access transfer state, shared by the blocking and IRQ driven modes */
+typedef struct {
+    const uint8_t *in;
+    uint8_t       *out;
+    uint32_t       in_words;
+    uint32_t       out_words;
+    uint32_t       block;       /* block size of the configured mode, in words */
+    uint32_t       drop;        /* scratch word for discarded output */
+} cryp_pio_t;
+
+/* @data_len is rounded down to whole blocks of the configured mode */
+static void cryp_pio_start(cryp_pio_t *pio, const uint8_t * data_in,
+                           uint8_t * data_out, uint32_t data_len)
+{
+    pio->in = data_in;
+    pio->out = data_out;
+    pio->block = cryp_block_size() / 4;
+    pio->in_words = (data_len / 4) & ~(pio->block - 1);
+    pio->out_words = pio->in_words;
+}
+
+/*
+ * Push to DIN and pull from DOUT whatever the FIFOs state (read once from SR)
+ * allows. Returns true if any word has been moved.
+ */
+static bool cryp_pio_step(cryp_pio_t *pio)
+{
+    uint32_t burst, j;
+    uint32_t sr;
+    bool progress = false;
+
+    sr = read_reg_value(r_CORTEX_M_CRYP_SR);
+
+    if ((sr & CRYP_SR_IFNF_Msk) && (pio->in_words > 0)) {
+        burst = pio->block;
+        if ((sr & CRYP_SR_IFEM_Msk) && (pio->in_words >= CRYP_FIFO_WORDS)) {
+            burst = CRYP_FIFO_WORDS;
+        }
+        for (j = 0; j < burst; j++) {
+            write_reg_value(r_CORTEX_M_CRYP_DIN, *(const uint32_t *) pio->in);
+            pio->in += 4;
+        }
+        pio->in_words -= burst;
+        progress = true;
+    }
+
+    if ((sr & CRYP_SR_OFNE_Msk) && (pio->out_words > 0)) {
+        burst = pio->block;
+        if ((sr & CRYP_SR_OFFU_Msk) && (pio->out_words >= CRYP_FIFO_WORDS)) {
+            burst = CRYP_FIFO_WORDS;
+        }
+        if (pio->out == NULL) {
+            /* output discarded (CBC-MAC), only the FIFO is drained */
+            for (j = 0; j < burst; j++) {
+                pio->drop = read_reg_value(r_CORTEX_M_CRYP_DOUT);
+            }
+        } else {
+            for (j = 0; j < burst; j++) {
+                *(uint32_t *) pio->out = read_reg_value(r_CORTEX_M_CRYP_DOUT);
+                pio->out += 4;
+            }
+        }
+        pio->out_words -= burst;
+        progress = true;
+    }
+
+    return progress;
+}
+
+/*
+ * In-place operation (@out == @in) is safe on every path: an output block
+ * only exists once its input block has been read, from the FIFOs as well as
+ * by the DMA streams (bounced chunks included), so that the output writes
+ * never overtake the input reads. Partially overlapping buffers give no such
+ * guarantee and are refused.
+ */
+static bool cryp_buffers_overlap(const uint8_t * in, const uint8_t * out, uint32_t len)
+{
+    physaddr_t a = (physaddr_t) in;
+    physaddr_t b = (physaddr_t) out;
+
+    /* the direct access paths ignore a trailing partial block */
+    len &= ~(cryp_block_size() - 1);
+
+    if ((out == NULL) || (a == b)) {
+        return false;
+    }
+    return (a < (b + len)) && (b < (a + len));
+}
+
 int cryp_do_no_dma(const uint8_t * data_in, uint8_t * data_out,
                     uint32_t data_len)
 {
-    uint32_t i, j;
+    cryp_pio_t pio;
+    uint32_t spins = 0;
 
+    if (cryp_buffers_overlap(data_in, data_out, data_len)) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP, partially overlapping buffers!\n");
+#endif
+        return -1;
+    }
     enable_crypt();
 
-    /* The CRYP FIFO is 8 words deep. Thus we can put
-     * two AES blocks inside it.
+    cryp_pio_start(&pio, data_in, data_out, data_len);
+    cryp_stats_bytes(cryp_cr_get(), pio.in_words * 4);
+
+    /* Feed DIN and drain DOUT in the same loop, so that the input FIFO is
+     * refilled while the core is working and the pipeline never empties
+     * before the end of the buffer.
      */
-    i = 0;
-    while (i < (data_len / 16)) {
-        uint32_t num_states = 1;
-        i++;
-        /* Consume two AES states if we can */
-        if (((data_len / 16) - i) > 1) {
-            num_states = 2;
-            i++;
+    cryp_stats_begin(CRYP_STATS_TRANSFER);
+    while (pio.out_words > 0) {
+        if (!cryp_pio_step(&pio)) {
+            spins++;
+        }
+    }
+    cryp_stats_end(CRYP_STATS_TRANSFER);
+    cryp_stats_spins(CRYP_STATS_WAIT_FIFO, spins);
+
+    cryp_stats_begin(CRYP_STATS_DRAIN);
+    cryp_spin_busy(CRYP_STATS_WAIT_DRAIN);
+    cryp_stats_end(CRYP_STATS_DRAIN);
+
+    return 0;
+}
+
+/*
+ * Same as cryp_do_no_dma(), without keeping the output: used for MACs, where
+ * only the chaining value left in the IV registers matters.
+ */
+int cryp_absorb_no_dma(const uint8_t * data_in, uint32_t data_len)
+{
+    return cryp_do_no_dma(data_in, NULL, data_len);
+}
+
+/* wait for the input FIFO to be consumed and the core to be idle */
+static void cryp_wait_input_done(void)
+{
+    uint32_t spins = 0;
+
+    while (get_reg_value(r_CORTEX_M_CRYP_SR, CRYP_SR_IFEM_Msk | CRYP_SR_BUSY_Msk, 0) != CRYP_SR_IFEM_Msk) {
+        spins++;
+    }
+    cryp_stats_spins(CRYP_STATS_WAIT_DRAIN, spins);
+}
+
+/* feed blocks that produce no output (GCM/CCM header phase) */
+int cryp_push_no_dma(const uint8_t * data_in, uint32_t data_len)
+{
+    cryp_pio_t pio;
+    uint32_t spins = 0;
+
+    enable_crypt();
+
+    cryp_pio_start(&pio, data_in, NULL, data_len);
+    cryp_stats_bytes(cryp_cr_get(), pio.in_words * 4);
+    pio.out_words = 0;
+    cryp_stats_begin(CRYP_STATS_TRANSFER);
+    while (pio.in_words > 0) {
+        if (!cryp_pio_step(&pio)) {
+            spins++;
+        }
+    }
+    cryp_stats_end(CRYP_STATS_TRANSFER);
+    cryp_stats_spins(CRYP_STATS_WAIT_FIFO, spins);
+    cryp_stats_begin(CRYP_STATS_DRAIN);
+    cryp_wait_input_done();
+    cryp_stats_end(CRYP_STATS_DRAIN);
+
+    return 0;
+}
+
+/*
+ * Context swap: the current message is suspended with the core idle, and can
+ * be resumed later after any other use of the engine. The GCM/CCM internal
+ * state is only saved for these modes. The key registers are write only, and
+ * are reloaded from the given key (NULL for a key known to be in place).
+ */
+void cryp_save_context(cryp_context_t * ctx)
+{
+    uint32_t i;
+
+    if (cryp_cr_get() & CRYP_CR_CRYPEN_Msk) {
+        cryp_wait_input_done();
+    }
+    disable_crypt();
+    ctx->cr = cryp_cr_get();
+    for (i = 0; i < 2; i++) {
+        ctx->iv[2 * i] = read_reg_value(r_CORTEX_M_CRYP_IVxLR(i));
+        ctx->iv[2 * i + 1] = read_reg_value(r_CORTEX_M_CRYP_IVxRR(i));
+    }
+    if (ctx->cr & CRYP_CR_ALGOMODE3_Msk) {
+        for (i = 0; i < 8; i++) {
+            ctx->csgcmccm[i] = read_reg_value(r_CORTEX_M_CRYP_CSGCMCCMxR(i));
+            ctx->csgcm[i] = read_reg_value(r_CORTEX_M_CRYP_CSGCMxR(i));
         }
+    }
+}
+
+void cryp_restore_context(const cryp_context_t * ctx,
+                          const uint8_t * key, enum crypto_key_len key_len)
+{
+    uint32_t i;
 
-        for (j = 0; j < (4 * num_states); j++) {
-            write_reg_value(r_CORTEX_M_CRYP_DIN, *(const uint32_t *) data_in);
-            data_in += 4;
+    cryp_cr_commit(ctx->cr & ~CRYP_CR_CRYPEN_Msk);
+    if (key && !cryp_key_cached(key, key_len, false, false)) {
+        cryp_set_key(key, key_len);
+    }
+    for (i = 0; i < 2; i++) {
+        write_reg_value(r_CORTEX_M_CRYP_IVxLR(i), ctx->iv[2 * i]);
+        write_reg_value(r_CORTEX_M_CRYP_IVxRR(i), ctx->iv[2 * i + 1]);
+    }
+    if (ctx->cr & CRYP_CR_ALGOMODE3_Msk) {
+        for (i = 0; i < 8; i++) {
+            write_reg_value(r_CORTEX_M_CRYP_CSGCMCCMxR(i), ctx->csgcmccm[i]);
+            write_reg_value(r_CORTEX_M_CRYP_CSGCMxR(i), ctx->csgcm[i]);
         }
-        while (!is_out_fifo_not_empty()){
-            continue;
+    }
+    cryp_cr_commit(ctx->cr | CRYP_CR_CRYPEN_Msk);
+}
+
+/*
+ * GCM/CCM phases (STM32F42x/F43x). The init phase runs with the key and the
+ * initial counter block loaded, plus the B0 block in the input FIFO for CCM,
+ * and the core clears CRYPEN once it is done. The other phases are switched
+ * with the input consumed and the core disabled.
+ */
+int cryp_gcm_ccm_init(const uint8_t * key, enum crypto_key_len key_len,
+                      const uint8_t * iv, enum crypto_algo mode, enum crypto_dir dir,
+                      const uint8_t * b0)
+{
+    uint32_t cr;
+    uint32_t i;
+    uint32_t spins = 0;
+
+    if (((mode != AES_GCM) && (mode != AES_CCM)) || (iv == NULL) ||
+        ((mode == AES_CCM) && (b0 == NULL))) {
+        goto err;
+    }
+
+    cr = cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk;
+    if (key) {
+        cr = cryp_cr_set(cr, key_len, CRYP_CR_KEYSIZE);
+    }
+    cr = cryp_cr_set(cr, CRYP_CR_DATATYPE_BYTES, CRYP_CR_DATATYPE);
+    cr = cryp_cr_set(cr, dir, CRYP_CR_ALGODIR);
+    cr = cryp_cr_set_algo(cr, mode);
+    cryp_cr_commit(cr | CRYP_CR_FFLUSH_Msk);
+
+    cryp_set_iv(iv, 16);
+    /* GCM and CCM work on the raw key */
+    if (key && !cryp_key_cached(key, key_len, false, false)) {
+        cryp_set_key(key, key_len);
+    }
+    if (mode == AES_CCM) {
+        for (i = 0; i < CRYP_AES_BLOCK_WORDS; i++) {
+            write_reg_value(r_CORTEX_M_CRYP_DIN, *(const uint32_t *) b0);
+            b0 += 4;
         }
-        for (j = 0; j < (4 * num_states); j++) {
-            *(uint32_t *) data_out = read_reg_value(r_CORTEX_M_CRYP_DOUT);
-            data_out += 4;
+    }
+
+    cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
+    while (get_reg(r_CORTEX_M_CRYP_CR, CRYP_CR_CRYPEN)) {
+        spins++;
+    }
+    cryp_stats_spins(CRYP_STATS_WAIT_CONFIG, spins);
+    cryp_cr_shadow = cr;
+
+    return 0;
+err:
+    return -1;
+}
+
+void cryp_gcm_ccm_phase(enum crypto_phase phase)
+{
+    uint32_t cr = cryp_cr_set(cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk, phase, CRYP_CR_GCM_CCMPH);
+
+    if ((cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk) != cr) {
+        if (cryp_cr_get() & CRYP_CR_CRYPEN_Msk) {
+            cryp_wait_input_done();
         }
+        cryp_cr_commit(cr);
+    }
+    cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
+}
+
+/*
+ * The F4 core can't be told how many bytes of the last payload block are
+ * padding, and authenticates the whole zero padded block. That is right when
+ * the authenticated data is the input (GCM decryption, CCM encryption), but
+ * not when it is the output (GCM encryption, CCM decryption). In that case,
+ * the block is processed once to get the output, then the context is
+ * restored and the zero padded output is processed in the other direction,
+ * only to update the authentication state.
+ */
+int cryp_gcm_ccm_last_block(const uint8_t * data_in, uint8_t * data_out, uint32_t data_len)
+{
+    uint32_t blk[CRYP_AES_BLOCK_WORDS];
+    uint32_t res[CRYP_AES_BLOCK_WORDS];
+    cryp_context_t ctx;
+    uint32_t cr = cryp_cr_get() & ~CRYP_CR_CRYPEN_Msk;
+    bool redo;
+
+    if (!(cr & CRYP_CR_ALGOMODE3_Msk) || (data_len == 0) || (data_len >= 16)) {
+        goto err;
+    }
+    /* ALGOMODE[0] is set for CCM, clear for GCM */
+    redo = ((cr & CRYP_CR_ALGOMODE_Msk) != 0) == ((cr & CRYP_CR_ALGODIR_Msk) != 0);
+
+    memset(blk, 0, sizeof(blk));
+    memcpy(blk, data_in, data_len);
+    if (redo) {
+        cryp_save_context(&ctx);
+    }
+    if (cryp_do_no_dma((const uint8_t *) blk, (uint8_t *) res, 16)) {
+        goto err;
+    }
+    memcpy(data_out, res, data_len);
 
-        while (!is_in_fifo_not_full()){
-            continue;
+    if (redo) {
+        memset((uint8_t *) res + data_len, 0, 16 - data_len);
+        ctx.cr ^= CRYP_CR_ALGODIR_Msk;
+        cryp_restore_context(&ctx, NULL, KEY_128);
+        if (cryp_do_no_dma((const uint8_t *) res, (uint8_t *) blk, 16)) {
+            goto err;
         }
+        /* back to the message direction */
+        cryp_wait_input_done();
+        cryp_cr_commit(cr);
+        cryp_cr_commit(cr | CRYP_CR_CRYPEN_Msk);
     }
+    memset(blk, 0, sizeof(blk));
+    memset(res, 0, sizeof(res));
+    return 0;
+err:
+    memset(blk, 0, sizeof(blk));
+    memset(res, 0, sizeof(res));
+    return -1;
+}
+
+/* final phase: @block is the lengths block (GCM) or the counter block 0 (CCM) */
+int cryp_gcm_ccm_final(const uint8_t * block, uint8_t * tag)
+{
+    int ret;
+
+    if (!(cryp_cr_get() & CRYP_CR_ALGOMODE3_Msk)) {
+        return -1;
+    }
+    cryp_gcm_ccm_phase(GCM_CCM_FINAL);
+    ret = cryp_do_no_dma(block, tag, 16);
+    disable_crypt();
+    return ret;
+}
 
-    while (is_busy()){
+#if CONFIG_USR_DRV_CRYP_IRQ
+/*
+ * Interrupt driven direct access mode. The kernel posthook masks IMSCR and
+ * saves MISR when the CRYP IRQ fires, then cryp_irq_handler() services the
+ * FIFOs and unmasks the sources that are still needed.
+ */
+static cryp_pio_t pio_async;
+static cryp_async_handler_t pio_async_handler = NULL;
+static volatile bool pio_async_running = false;
+
+/* complete the transfer, or unmask the FIFO service requests still needed */
+static void cryp_pio_async_rearm(void)
+{
+    uint32_t imscr = 0;
+
+    if (pio_async.out_words == 0) {
+        write_reg_value(r_CORTEX_M_CRYP_IMSCR, 0);
+        cryp_stats_end(CRYP_STATS_TRANSFER);
+        pio_async_running = false;
+        if (pio_async_handler) {
+            pio_async_handler(0);
+        }
+        return;
+    }
+    if (pio_async.in_words > 0) {
+        imscr |= CRYP_IMSCR_INIM_Msk;
+    }
+    imscr |= CRYP_IMSCR_OUTIM_Msk;
+    write_reg_value(r_CORTEX_M_CRYP_IMSCR, imscr);
+}
+
+static void cryp_pio_async_service(void)
+{
+    while (cryp_pio_step(&pio_async)) {
         continue;
     }
+    cryp_pio_async_rearm();
+}
+
+static void cryp_irq_handler(uint8_t irq __attribute__((unused)),
+                             uint32_t status __attribute__((unused)),
+                             uint32_t data __attribute__((unused)))
+{
+    if (!pio_async_running) {
+        write_reg_value(r_CORTEX_M_CRYP_IMSCR, 0);
+        return;
+    }
+    cryp_pio_async_service();
+}
+
+int cryp_do_no_dma_async(const uint8_t * data_in, uint8_t * data_out,
+                         uint32_t data_len, cryp_async_handler_t handler)
+{
+    if (pio_async_running) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP, asynchronous transfer already running!\n");
+#endif
+        goto err;
+    }
+    if ((((physaddr_t)data_in % 4) != 0) || (((physaddr_t)data_out % 4) != 0) ||
+        cryp_buffers_overlap(data_in, data_out, data_len)) {
+        goto err;
+    }
+
+    pio_async_handler = handler;
+    cryp_pio_start(&pio_async, data_in, data_out, data_len);
+    cryp_stats_bytes(cryp_cr_get(), pio_async.in_words * 4);
+    cryp_stats_begin(CRYP_STATS_TRANSFER);
+    pio_async_running = true;
+
+    enable_crypt();
+    /* prime the input FIFO, the IRQ does the rest */
+    cryp_pio_step(&pio_async);
+    cryp_pio_async_rearm();
 
     return 0;
+err:
+    return -1;
 }
 
+bool cryp_async_busy(void)
+{
+    return pio_async_running;
+}
+#endif
+
 static dma_t dma_in;
 static dma_t dma_out;
 
+/*
+ * What the kernel currently holds for each CRYP DMA stream. A transfer only
+ * reconfigures the fields that changed since the previous one, and simply
+ * reloads the stream when nothing changed at all.
+ *
+ * Buffers larger than CRYP_DMA_MAX_SIZE are split in chunks: each stream is
+ * reloaded with its next chunk from its own completion handler, so that the
+ * input stream of chunk N+1 already feeds the Cryp while the output stream
+ * of chunk N is still draining it. The caller handlers are only called once
+ * the whole buffer has been transferred.
+ *
+ * A buffer the DMA can not use as is (not word aligned, or out of the DMA
+ * reach) is bounced: its stream moves chunks of CRYP_DMA_BOUNCE_HALF bytes
+ * through two halves of a static bounce area, alternately. The next input
+ * chunk is copied in the free half while the current one is transferred, and
+ * an output chunk is copied out once the stream has been reloaded on the
+ * other half, so that the copies overlap with the transfers.
+ */
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+#if (CONFIG_USR_DRV_CRYP_BOUNCE_SIZE % 64) || (CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0xfff0)
+#error "CONFIG_USR_DRV_CRYP_BOUNCE_SIZE must be a multiple of 64, up to 0xfff0"
+#endif
+#define CRYP_DMA_BOUNCE_HALF    (CONFIG_USR_DRV_CRYP_BOUNCE_SIZE / 4)
 
-int cryp_do_dma(const uint8_t * bufin, const uint8_t * bufout, uint32_t size, int dma_in_desc, int dma_out_desc)
+static uint32_t cryp_dma_bounce[2][2][CRYP_DMA_BOUNCE_HALF / 4];
+#endif
+
+typedef struct {
+    dma_t      *dma;
+    int         desc;
+    bool        loaded;
+    physaddr_t  addr;       /* memory side address */
+    uint32_t    size;
+    physaddr_t  next;       /* next chunk memory address */
+    uint32_t    left;       /* bytes not handed to the stream yet */
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    bool        bounced;    /* next is in the caller buffer, not DMA-able */
+    uint8_t    *half[2];    /* bounce halves */
+    uint32_t    cur;        /* half handed to the stream last */
+    bool        staged;     /* input: next chunk already in the other half */
+    physaddr_t  dst[2];     /* output: caller destination of each half */
+    uint32_t    dst_size[2];
+#endif
+} cryp_dma_stream_t;
+
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+#define CRYP_DMA_STREAM_INIT(dma) \
+    { dma, 0, false, 0, 0, 0, 0, false, { NULL, NULL }, 1, false, { 0, 0 }, { 0, 0 } }
+#else
+#define CRYP_DMA_STREAM_INIT(dma)   { dma, 0, false, 0, 0, 0, 0 }
+#endif
+
+static struct {
+    bool                prepared;
+    bool                failed;     /* a chunk of the transfer could not be chained */
+    cryp_dma_stream_t   in;
+    cryp_dma_stream_t   out;
+} cryp_dma_ctx = {
+    false,
+    false,
+    CRYP_DMA_STREAM_INIT(&dma_in),
+    CRYP_DMA_STREAM_INIT(&dma_out)
+};
+
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+/* the CCM data RAM is not reachable by the DMA controllers */
+#define CRYP_CCMRAM_BASE    0x10000000
+#define CRYP_CCMRAM_END     0x10010000
+
+static bool cryp_dma_must_bounce(const uint8_t * buf, uint32_t size)
 {
-    /* DMA addresses must be word aligned, perform a sanity check */
-    if((((uint32_t)bufin % 4) != 0) || (((uint32_t)bufout % 4) != 0)){
-#if CONFIG_USR_DRV_CRYP_DEBUG
-        printf("Error: DMA CRYP, DMA buffers addresses not word aligned! (bufin=%x, bufout=%x)\n", bufin, bufout);
+    physaddr_t addr = (physaddr_t) buf;
+
+    if ((addr % 4) != 0) {
+        return true;
+    }
+    return (addr < CRYP_CCMRAM_END) && ((addr + size) > CRYP_CCMRAM_BASE);
+}
+
+static void cryp_dma_stream_bounce(cryp_dma_stream_t *st, bool bounced)
+{
+    uint32_t i = (st == &cryp_dma_ctx.in) ? 0 : 1;
+
+    st->bounced = bounced;
+    st->half[0] = (uint8_t *) cryp_dma_bounce[i][0];
+    st->half[1] = (uint8_t *) cryp_dma_bounce[i][1];
+    st->cur = 1;
+    st->staged = false;
+}
+
+/* output stream: copy the chunk of the completed half to the caller buffer */
+static void cryp_dma_bounce_out(cryp_dma_stream_t *st, uint32_t h)
+{
+    memcpy((void *) st->dst[h], st->half[h], st->dst_size[h]);
+    st->dst_size[h] = 0;
+}
 #endif
-        goto err;
+
+/* caller handlers, called when the whole buffer has been transferred */
+static user_dma_handler_t cryp_dma_handler_in = NULL;
+static user_dma_handler_t cryp_dma_handler_out = NULL;
+static bool cryp_dma_handlers_set = false;
+
+int cryp_dma_prepare(int dma_in_desc, int dma_out_desc)
+{
+    if (cryp_dma_ctx.prepared &&
+        (cryp_dma_ctx.in.desc == dma_in_desc) &&
+        (cryp_dma_ctx.out.desc == dma_out_desc)) {
+        return 0;
     }
 
-    cryp_enable_dma();
-    e_syscall_ret ret;
     dma_in.dma          = DMA_CRYP;
     dma_in.stream       = DMA_STREAM_CRYP_IN;
     dma_in.channel      = DMA_CHANNEL_CRYP_IN;
     dma_in.dir          = MEMORY_TO_PERIPHERAL;
-    dma_in.in_addr      = (physaddr_t) bufin;
+    dma_in.in_addr      = (physaddr_t) 0;
     dma_in.out_addr     = (volatile physaddr_t)r_CORTEX_M_CRYP_DIN;
     dma_in.in_prio      = DMA_PRI_MEDIUM;
-    dma_in.size         = size;
+    dma_in.size         = 0;
     dma_in.mode         = DMA_DIRECT_MODE;
     dma_in.mem_inc      = 1;
     dma_in.dev_inc      = 0;
@@ -414,60 +1240,242 @@ int cryp_do_dma(const uint8_t * bufin, const uint8_t * bufout, uint32_t size, in
     dma_in.in_handler   = (user_dma_handler_t) 0;
     dma_in.out_handler  = (user_dma_handler_t) 0;    /* not used */
 
-#if CONFIG_USR_DRV_CRYP_DEBUG
-    printf("init DMA CRYP in...\n");
-#endif
-
-    ret =
-        sys_cfg(CFG_DMA_RECONF, &dma_in,
-                (DMA_RECONF_BUFIN | DMA_RECONF_BUFOUT | DMA_RECONF_BUFSIZE),
-                dma_in_desc);
-    if(ret != SYS_E_DONE){
-#if CONFIG_USR_DRV_CRYP_DEBUG
-        printf("Error: DMA CRYP, sys_cfg CFG_DMA_RECONF error!\n");
-#endif
-        goto err;
-    }
-#if CONFIG_USR_DRV_CRYP_DEBUG
-    printf("sys_init returns %s !\n", strerror(ret));
-#endif
-    // done by INIT_DONE, by kernel.
-
     dma_out.dma         = DMA_CRYP;
     dma_out.stream      = DMA_STREAM_CRYP_OUT;
     dma_out.channel     = DMA_CHANNEL_CRYP_OUT;
     dma_out.dir         = PERIPHERAL_TO_MEMORY;
     dma_out.in_addr     = (volatile physaddr_t)r_CORTEX_M_CRYP_DOUT;
-    dma_out.out_addr    = (physaddr_t) bufout;
+    dma_out.out_addr    = (physaddr_t) 0;
     dma_out.out_prio    = DMA_PRI_HIGH;
-    dma_out.size        = size;
+    dma_out.size        = 0;
     dma_out.mode        = DMA_DIRECT_MODE;
     dma_out.mem_inc     = 1;
     dma_out.dev_inc     = 0;
     dma_out.datasize    = DMA_DS_WORD;
     dma_out.mem_burst   = DMA_BURST_INC4;
     dma_out.dev_burst   = DMA_BURST_INC4;
-    dma_in.flow_control = DMA_FLOWCTRL_DMA;
+    dma_out.flow_control = DMA_FLOWCTRL_DMA;
     dma_out.in_handler  = (user_dma_handler_t) 0;    /* not used */
     dma_out.out_handler = (user_dma_handler_t) 0;
 
-#if CONFIG_USR_DRV_CRYP_DEBUG
-    printf("init DMA CRYP out...\n");
+    cryp_dma_ctx.in.desc = dma_in_desc;
+    cryp_dma_ctx.in.loaded = false;
+    cryp_dma_ctx.in.left = 0;
+    cryp_dma_ctx.out.desc = dma_out_desc;
+    cryp_dma_ctx.out.loaded = false;
+    cryp_dma_ctx.out.left = 0;
+    cryp_dma_ctx.prepared = true;
+
+    return 0;
+}
+
+/* hand the next chunk of the buffer to the stream */
+static int cryp_dma_stream_next(cryp_dma_stream_t *st)
+{
+    e_syscall_ret ret;
+    uint8_t mask = 0;
+    physaddr_t addr = st->next;
+    uint32_t size = st->left;
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    uint32_t h = st->cur ^ 1;
+    uint32_t n;
 #endif
 
-    ret =
-        sys_cfg(CFG_DMA_RECONF, & dma_out,
-                (DMA_RECONF_BUFIN | DMA_RECONF_BUFOUT | DMA_RECONF_BUFSIZE),
-                dma_out_desc);
+    if (size > CRYP_DMA_MAX_SIZE) {
+        size = CRYP_DMA_MAX_SIZE;
+    }
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    if (st->bounced) {
+        if (size > CRYP_DMA_BOUNCE_HALF) {
+            size = CRYP_DMA_BOUNCE_HALF;
+        }
+        if ((st == &cryp_dma_ctx.in) && !st->staged) {
+            memcpy(st->half[h], (const void *) st->next, size);
+        }
+        addr = (physaddr_t) st->half[h];
+    }
+#endif
+
+    if (!st->loaded || (st->addr != addr)) {
+        mask |= (st == &cryp_dma_ctx.in) ? DMA_RECONF_BUFIN : DMA_RECONF_BUFOUT;
+    }
+    if (!st->loaded || (st->size != size)) {
+        mask |= DMA_RECONF_BUFSIZE;
+    }
+
+    /* the kernel state is only known again once the stream is reconfigured */
+    st->loaded = false;
+
+    if (st == &cryp_dma_ctx.in) {
+        st->dma->in_addr = addr;
+    } else {
+        st->dma->out_addr = addr;
+    }
+    st->dma->size = size;
+    cryp_trace_event((st == &cryp_dma_ctx.in) ? CRYP_TRACE_DMA_IN : CRYP_TRACE_DMA_OUT, size);
+    cryp_stats_begin(CRYP_STATS_DMA_CONFIG);
+    if (mask) {
+        ret = sys_cfg(CFG_DMA_RECONF, st->dma, mask, st->desc);
+    } else {
+        ret = sys_cfg(CFG_DMA_RELOAD, st->desc);
+    }
+    cryp_stats_end(CRYP_STATS_DMA_CONFIG);
     if(ret != SYS_E_DONE){
 #if CONFIG_USR_DRV_CRYP_DEBUG
         printf("Error: DMA CRYP, sys_cfg CFG_DMA_RECONF error!\n");
 #endif
+        st->left = 0;
         goto err;
     }
+
+    st->addr = addr;
+    st->size = size;
+    st->loaded = true;
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    if (st->bounced) {
+        st->cur = h;
+        st->staged = false;
+        st->dst[h] = st->next;
+        st->dst_size[h] = size;
+    }
+#endif
+    st->next += size;
+    st->left -= size;
+
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    /* stage the next input chunk while this one is transferred */
+    if (st->bounced && (st == &cryp_dma_ctx.in) && (st->left > 0)) {
+        n = (st->left > CRYP_DMA_BOUNCE_HALF) ? CRYP_DMA_BOUNCE_HALF : st->left;
+        memcpy(st->half[h ^ 1], (const void *) st->next, n);
+        st->staged = true;
+    }
+#endif
+    return 0;
+
+err:
+    return -1;
+}
+
+static void cryp_dma_in_handler(uint8_t irq, uint32_t status)
+{
+    if (cryp_dma_ctx.in.left > 0) {
+        if (cryp_dma_stream_next(&cryp_dma_ctx.in) == 0) {
+            return;
+        }
+        /* the output stream ends with the chunk it is on, reporting the error */
+        cryp_dma_ctx.failed = true;
+        cryp_dma_ctx.out.left = 0;
+    }
+    if (cryp_dma_ctx.failed) {
+        status |= CRYP_DMA_STATUS_ERROR;
+    }
+    if (cryp_dma_handler_in) {
+        cryp_dma_handler_in(irq, status);
+    }
+}
+
+static void cryp_dma_out_handler(uint8_t irq, uint32_t status)
+{
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    cryp_dma_stream_t *st = &cryp_dma_ctx.out;
+    uint32_t done = st->cur;
+
+    if (st->bounced) {
+        /* reload the stream on the other half first, then copy this one out */
+        if (st->left > 0) {
+            if (cryp_dma_stream_next(st) == 0) {
+                cryp_dma_bounce_out(st, done);
+                return;
+            }
+            cryp_dma_ctx.failed = true;
+        }
+        cryp_dma_bounce_out(st, done);
+    }
+#endif
+    if (cryp_dma_ctx.out.left > 0) {
+        if (cryp_dma_stream_next(&cryp_dma_ctx.out) == 0) {
+            return;
+        }
+        cryp_dma_ctx.failed = true;
+    }
+    cryp_stats_end(CRYP_STATS_TRANSFER);
+    if (cryp_dma_ctx.failed) {
+        status |= CRYP_DMA_STATUS_ERROR;
+    }
+    if (cryp_dma_handler_out) {
+        cryp_dma_handler_out(irq, status);
+    }
+}
+
+int cryp_dma_launch(const uint8_t * bufin, const uint8_t * bufout, uint32_t size)
+{
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    bool bounce_in, bounce_out;
+#endif
+
+    if (!cryp_dma_ctx.prepared) {
 #if CONFIG_USR_DRV_CRYP_DEBUG
-    printf("sys_init returns %s !\n", strerror(ret));
+        printf("Error: DMA CRYP, launching an unprepared transfer!\n");
+#endif
+        goto err;
+    }
+    if (cryp_buffers_overlap(bufin, bufout, size)) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: DMA CRYP, partially overlapping buffers!\n");
+#endif
+        goto err;
+    }
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    /* in place, both streams bounce alike: see cryp_buffers_overlap() */
+    bounce_in = cryp_dma_must_bounce(bufin, size);
+    bounce_out = cryp_dma_must_bounce(bufout, size);
+    /* bounced chunks are chained and copied out from the DMA handlers */
+    if ((bounce_in || bounce_out) && !cryp_dma_handlers_set) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: DMA CRYP, bouncing buffers requires the DMA handlers!\n");
 #endif
+        goto err;
+    }
+    cryp_dma_stream_bounce(&cryp_dma_ctx.in, bounce_in);
+    cryp_dma_stream_bounce(&cryp_dma_ctx.out, bounce_out);
+#else
+    /* DMA addresses must be word aligned, perform a sanity check */
+    if((((physaddr_t)bufin % 4) != 0) || (((physaddr_t)bufout % 4) != 0)){
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: DMA CRYP, DMA buffers addresses not word aligned! (bufin=%x, bufout=%x)\n", bufin, bufout);
+#endif
+        goto err;
+    }
+#endif
+    /* chunks are chained from the DMA handlers installed by cryp_init_dma() */
+    if ((size > CRYP_DMA_MAX_SIZE) && !cryp_dma_handlers_set) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: DMA CRYP, buffer too big for a single DMA transfer!\n");
+#endif
+        goto err;
+    }
+
+    if ((read_reg_value(r_CORTEX_M_CRYP_DMACR) & (CRYP_DMACR_DIEN_Msk | CRYP_DMACR_DOEN_Msk)) !=
+        (CRYP_DMACR_DIEN_Msk | CRYP_DMACR_DOEN_Msk)) {
+        cryp_enable_dma();
+    }
+
+    cryp_dma_ctx.failed = false;
+    cryp_dma_ctx.in.next = (physaddr_t) bufin;
+    cryp_dma_ctx.in.left = size;
+    cryp_dma_ctx.out.next = (physaddr_t) bufout;
+    cryp_dma_ctx.out.left = size;
+    cryp_stats_bytes(cryp_cr_get(), size);
+    cryp_stats_begin(CRYP_STATS_TRANSFER);
+
+    if (cryp_dma_stream_next(&cryp_dma_ctx.in)) {
+        cryp_dma_ctx.out.left = 0;
+        goto err;
+    }
+    if (cryp_dma_stream_next(&cryp_dma_ctx.out)) {
+        cryp_dma_ctx.in.left = 0;
+        goto err;
+    }
 
     return 0;
 
@@ -475,11 +1483,61 @@ err:
     return -1;
 }
 
+/* input stream only, for data producing no output (GCM/CCM header phase) */
+int cryp_dma_launch_in(const uint8_t * bufin, uint32_t size)
+{
+    if (!cryp_dma_ctx.prepared) {
+        goto err;
+    }
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+    if (cryp_dma_must_bounce(bufin, size) && !cryp_dma_handlers_set) {
+        goto err;
+    }
+    cryp_dma_stream_bounce(&cryp_dma_ctx.in, cryp_dma_must_bounce(bufin, size));
+#else
+    if (((physaddr_t)bufin % 4) != 0) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: DMA CRYP, DMA buffer address not word aligned! (bufin=%x)\n", bufin);
+#endif
+        goto err;
+    }
+#endif
+    if ((size > CRYP_DMA_MAX_SIZE) && !cryp_dma_handlers_set) {
+        goto err;
+    }
+
+    if (!get_reg(r_CORTEX_M_CRYP_DMACR, CRYP_DMACR_DIEN)) {
+        cryp_enable_dma();
+    }
+
+    cryp_dma_ctx.failed = false;
+    cryp_dma_ctx.in.next = (physaddr_t) bufin;
+    cryp_dma_ctx.in.left = size;
+    cryp_dma_ctx.out.left = 0;
+    cryp_stats_bytes(cryp_cr_get(), size);
+
+    return cryp_dma_stream_next(&cryp_dma_ctx.in);
+err:
+    return -1;
+}
+
+int cryp_do_dma(const uint8_t * bufin, const uint8_t * bufout, uint32_t size, int dma_in_desc, int dma_out_desc)
+{
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        return -1;
+    }
+    return cryp_dma_launch(bufin, bufout, size);
+}
+
 int cryp_init_dma(user_dma_handler_t handler_in, user_dma_handler_t handler_out, int dma_in_desc,
                    int dma_out_desc)
 {
     e_syscall_ret ret;
     cryp_disable_dma();
+    cryp_dma_ctx.prepared = false;
+    cryp_dma_handlers_set = false;
+    cryp_dma_handler_in = handler_in;
+    cryp_dma_handler_out = handler_out;
 
     dma_in.dma      = DMA_CRYP;
     dma_in.stream   = DMA_STREAM_CRYP_IN;
@@ -495,16 +1553,18 @@ int cryp_init_dma(user_dma_handler_t handler_in, user_dma_handler_t handler_out,
     dma_in.datasize = DMA_DS_WORD;
     dma_in.mem_burst    = DMA_BURST_INC4;
     dma_in.dev_burst    = DMA_BURST_INC4;
-    dma_in.in_handler   = (user_dma_handler_t) handler_in;
-    dma_in.out_handler  = (user_dma_handler_t) handler_out;  /* not used */
+    dma_in.in_handler   = cryp_dma_in_handler;
+    dma_in.out_handler  = cryp_dma_out_handler;  /* not used */
 
 #if CONFIG_USR_DRV_CRYP_DEBUG
     printf("init DMA CRYP in...\n");
 #endif
 
+    cryp_stats_begin(CRYP_STATS_DMA_CONFIG);
     ret = sys_cfg(CFG_DMA_RECONF, &dma_in,
                   (DMA_RECONF_HANDLERS | DMA_RECONF_MODE | DMA_RECONF_PRIO),
                   dma_in_desc);
+    cryp_stats_end(CRYP_STATS_DMA_CONFIG);
     if(ret != SYS_E_DONE){
 #if CONFIG_USR_DRV_CRYP_DEBUG
         printf("Error: DMA CRYP, sys_cfg CFG_DMA_RECONF error!\n");
@@ -530,17 +1590,19 @@ int cryp_init_dma(user_dma_handler_t handler_in, user_dma_handler_t handler_out,
     dma_out.datasize    = DMA_DS_WORD;
     dma_out.mem_burst   = DMA_BURST_INC4;
     dma_out.dev_burst   = DMA_BURST_INC4;
-    dma_out.in_handler  = (user_dma_handler_t) handler_in;   /* not used */
-    dma_out.out_handler = (user_dma_handler_t) handler_out;
+    dma_out.in_handler  = cryp_dma_in_handler;   /* not used */
+    dma_out.out_handler = cryp_dma_out_handler;
 
 #if CONFIG_USR_DRV_CRYP_DEBUG
     printf("init DMA CRYP out...\n");
 #endif
 
+    cryp_stats_begin(CRYP_STATS_DMA_CONFIG);
     ret =
         sys_cfg(CFG_DMA_RECONF, &dma_out,
                 (DMA_RECONF_HANDLERS | DMA_RECONF_MODE | DMA_RECONF_PRIO),
                 dma_out_desc);
+    cryp_stats_end(CRYP_STATS_DMA_CONFIG);
     if(ret != SYS_E_DONE){
 #if CONFIG_USR_DRV_CRYP_DEBUG
         printf("Error: DMA CRYP, sys_cfg CFG_DMA_RECONF error!\n");
@@ -551,6 +1613,7 @@ int cryp_init_dma(user_dma_handler_t handler_in, user_dma_handler_t handler_out,
 #if CONFIG_USR_DRV_CRYP_DEBUG
     printf("sys_init returns %s !\n", strerror(ret));
 #endif
+    cryp_dma_handlers_set = true;
     cryp_enable_dma();
 
     return 0;
@@ -589,11 +1652,28 @@ int cryp_early_init(bool with_dma,
     if (map_mode == CRYP_MAP_AUTO) {
       dev.map_mode = DEV_MAP_AUTO;
       cryp_is_mapped = true;
+      cryp_map_auto = true;
     } else {
       dev.map_mode = DEV_MAP_VOLUNTARY;
     }
     dev.irq_num = 0;
     dev.gpio_num = 0;
+#if CONFIG_USR_DRV_CRYP_IRQ
+    /* the CRYP FIFO service requests are level triggered: the posthook
+     * saves MISR and masks every source until the handler services them */
+    dev.irq_num = 1;
+    dev.irqs[0].handler = cryp_irq_handler;
+    dev.irqs[0].irq = CRYP_IRQ;
+    dev.irqs[0].mode = IRQ_ISR_STANDARD;
+    dev.irqs[0].posthook.status = 0x001c;   /* MISR */
+    dev.irqs[0].posthook.action[0].instr = IRQ_PH_READ;
+    dev.irqs[0].posthook.action[0].read.offset = 0x001c;
+    dev.irqs[0].posthook.action[1].instr = IRQ_PH_WRITE;
+    dev.irqs[0].posthook.action[1].write.offset = 0x0014;  /* IMSCR */
+    dev.irqs[0].posthook.action[1].write.value = 0;
+    dev.irqs[0].posthook.action[1].write.mask =
+        CRYP_IMSCR_INIM_Msk | CRYP_IMSCR_OUTIM_Msk;
+#endif
 
 #if CONFIG_USR_DRV_CRYP_DEBUG
     printf("registering cryp-user driver\n");
@@ -614,6 +1694,7 @@ int cryp_early_init(bool with_dma,
     if (!with_dma) {
       goto end;
     }
+    cryp_dma_ctx.prepared = false;
     dma_in.channel = DMA_CHANNEL_CRYP_IN;
     dma_in.dir = MEMORY_TO_PERIPHERAL;
     dma_in.in_addr = (physaddr_t) 0;
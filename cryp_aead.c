@@ -0,0 +1,433 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Authenticated encryption (AES-GCM and AES-CCM, STM32F42x/F43x).
+ *
+ * A message goes through the init, header, payload and final phases of the
+ * Cryp core, in that order, the header and payload phases being optional.
+ * Header data is staged in the context until a whole block is available,
+ * so that it can be given in chunks of any size (the CCM header also starts
+ * with its encoded length). Only one message is loaded in the engine at a
+ * time: the others must be suspended, their engine state being saved in
+ * their context by the context swap registers.
+ */
+
+#define CRYP_AEAD_BLOCK     16
+
+/* message currently loaded in the engine */
+static cryp_aead_t *aead_active = NULL;
+
+static struct {
+    cryp_aead_handler_t handler;
+    bool                ready;
+    bool                used;           /* DMA requests enabled since last PIO */
+    volatile bool       running;
+    bool                header;         /* running transfer is a header one */
+} aead_dma = { NULL, false, false, false, false };
+
+static inline bool cryp_aead_owned(const cryp_aead_t * ctx)
+{
+    return (ctx != NULL) && (ctx == aead_active) && !ctx->suspended && !aead_dma.running;
+}
+
+static void cryp_aead_put_be(uint8_t * buf, uint32_t len, uint64_t val)
+{
+    while (len > 0) {
+        buf[--len] = (uint8_t) val;
+        val >>= 8;
+    }
+}
+
+int cryp_aead_init(cryp_aead_t * ctx, enum crypto_algo mode, enum crypto_dir dir,
+                   const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * nonce, uint32_t nonce_len,
+                   uint32_t header_len, uint32_t payload_len, uint32_t tag_len)
+{
+    uint8_t iv[CRYP_AEAD_BLOCK] __attribute__((aligned(4)));
+    uint8_t b0[CRYP_AEAD_BLOCK] __attribute__((aligned(4)));
+    uint32_t q;
+
+    if ((ctx == NULL) || (nonce == NULL) || aead_dma.running ||
+        (tag_len < 4) || (tag_len > CRYP_AEAD_BLOCK)) {
+        goto err;
+    }
+    /* a message loaded and not suspended is dropped */
+    aead_active = NULL;
+    memset(ctx, 0, sizeof(cryp_aead_t));
+    ctx->mode = mode;
+    ctx->dir = dir;
+    ctx->key = key;
+    ctx->key_len = key_len;
+    ctx->tag_len = tag_len;
+    ctx->header_len = header_len;
+    ctx->payload_len = payload_len;
+    ctx->phase = GCM_CCM_INIT;
+
+    memset(iv, 0, CRYP_AEAD_BLOCK);
+    if (mode == AES_GCM) {
+        /* J0 = nonce || 1, the payload starting with J0 + 1 */
+        if (nonce_len != 12) {
+            goto err;
+        }
+        memcpy(iv, nonce, 12);
+        iv[15] = 2;
+        if (cryp_gcm_ccm_init(key, key_len, iv, mode, dir, NULL)) {
+            goto err;
+        }
+    } else if (mode == AES_CCM) {
+        /* NIST SP 800-38C: q bytes of payload length, even tag length */
+        if ((nonce_len < 7) || (nonce_len > 13) || (tag_len & 1)) {
+            goto err;
+        }
+        q = 15 - nonce_len;
+        if ((q < 4) && (payload_len >> (8 * q))) {
+            goto err;
+        }
+        b0[0] = (uint8_t)(((header_len > 0) << 6) | (((tag_len - 2) / 2) << 3) | (q - 1));
+        memcpy(&b0[1], nonce, nonce_len);
+        cryp_aead_put_be(&b0[1 + nonce_len], q, payload_len);
+
+        ctx->ctr0[0] = (uint8_t)(q - 1);
+        memcpy(&ctx->ctr0[1], nonce, nonce_len);
+        memcpy(iv, ctx->ctr0, CRYP_AEAD_BLOCK);
+        iv[15] = 1;
+        if (cryp_gcm_ccm_init(key, key_len, iv, mode, dir, b0)) {
+            goto err;
+        }
+        /* the header starts with its encoded length */
+        if (header_len > 0) {
+            if (header_len < 0xff00) {
+                cryp_aead_put_be(ctx->blk, 2, header_len);
+                ctx->blk_len = 2;
+            } else {
+                ctx->blk[0] = 0xff;
+                ctx->blk[1] = 0xfe;
+                cryp_aead_put_be(&ctx->blk[2], 4, header_len);
+                ctx->blk_len = 6;
+            }
+        }
+    } else {
+        goto err;
+    }
+    aead_active = ctx;
+    return 0;
+err:
+    return -1;
+}
+
+/* leave the init or header phase for @phase, flushing the staged header */
+static int cryp_aead_enter(cryp_aead_t * ctx, enum crypto_phase phase)
+{
+    if (ctx->phase > phase) {
+        return -1;
+    }
+    if (aead_dma.used) {
+        /* no DMA request must be pending while feeding the FIFOs by hand */
+        cryp_disable_dma();
+        aead_dma.used = false;
+    }
+    if (ctx->phase == phase) {
+        return 0;
+    }
+    if ((ctx->mode == AES_CCM) && (ctx->header_done != ctx->header_len)) {
+        return -1;
+    }
+    if (ctx->blk_len > 0) {
+        if (ctx->phase == GCM_CCM_INIT) {
+            cryp_gcm_ccm_phase(GCM_CCM_HEADER);
+        }
+        memset(&ctx->blk[ctx->blk_len], 0, CRYP_AEAD_BLOCK - ctx->blk_len);
+        cryp_push_no_dma(ctx->blk, CRYP_AEAD_BLOCK);
+        ctx->blk_len = 0;
+    }
+    /* the final phase is entered by cryp_gcm_ccm_final() */
+    if (phase != GCM_CCM_FINAL) {
+        cryp_gcm_ccm_phase(phase);
+    }
+    ctx->phase = phase;
+    return 0;
+}
+
+int cryp_aead_header(cryp_aead_t * ctx, const uint8_t * data, uint32_t len)
+{
+    uint32_t n;
+
+    if (!cryp_aead_owned(ctx) || ((len > 0) && (data == NULL))) {
+        goto err;
+    }
+    if ((ctx->mode == AES_CCM) && (len > (ctx->header_len - ctx->header_done))) {
+        goto err;
+    }
+    if (ctx->phase != GCM_CCM_HEADER) {
+        if (ctx->phase != GCM_CCM_INIT) {
+            goto err;
+        }
+        if (aead_dma.used) {
+            cryp_disable_dma();
+            aead_dma.used = false;
+        }
+        cryp_gcm_ccm_phase(GCM_CCM_HEADER);
+        ctx->phase = GCM_CCM_HEADER;
+    }
+    ctx->header_done += len;
+
+    /* complete the staged block */
+    if (ctx->blk_len > 0) {
+        n = CRYP_AEAD_BLOCK - ctx->blk_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&ctx->blk[ctx->blk_len], data, n);
+        ctx->blk_len += n;
+        data += n;
+        len -= n;
+        if (ctx->blk_len < CRYP_AEAD_BLOCK) {
+            return 0;
+        }
+        cryp_push_no_dma(ctx->blk, CRYP_AEAD_BLOCK);
+        ctx->blk_len = 0;
+    }
+    /* whole blocks straight from the caller buffer */
+    n = len - (len % CRYP_AEAD_BLOCK);
+    if (n > 0) {
+        cryp_push_no_dma(data, n);
+        data += n;
+        len -= n;
+    }
+    memcpy(ctx->blk, data, len);
+    ctx->blk_len = len;
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_aead_payload(cryp_aead_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                      uint32_t len)
+{
+    uint32_t n;
+
+    if (!cryp_aead_owned(ctx) || ctx->closed ||
+        ((len > 0) && ((data_in == NULL) || (data_out == NULL)))) {
+        goto err;
+    }
+    if ((ctx->mode == AES_CCM) && (len > (ctx->payload_len - ctx->payload_done))) {
+        goto err;
+    }
+    if (cryp_aead_enter(ctx, GCM_CCM_PAYLOAD)) {
+        goto err;
+    }
+    ctx->payload_done += len;
+
+    n = len - (len % CRYP_AEAD_BLOCK);
+    if ((n > 0) && cryp_do_no_dma(data_in, data_out, n)) {
+        goto err;
+    }
+    if (len > n) {
+        /* a partial block ends the payload */
+        ctx->closed = true;
+        if (cryp_gcm_ccm_last_block(data_in + n, data_out + n, len - n)) {
+            goto err;
+        }
+    }
+    return 0;
+err:
+    return -1;
+}
+
+static int cryp_aead_tag(cryp_aead_t * ctx, uint8_t * tag)
+{
+    uint8_t block[CRYP_AEAD_BLOCK] __attribute__((aligned(4)));
+
+    if (!cryp_aead_owned(ctx)) {
+        goto err;
+    }
+    if ((ctx->mode == AES_CCM) && (ctx->payload_done != ctx->payload_len)) {
+        goto err;
+    }
+    if (cryp_aead_enter(ctx, GCM_CCM_FINAL)) {
+        goto err;
+    }
+    if (ctx->mode == AES_GCM) {
+        /* len(A) || len(C), in bits */
+        cryp_aead_put_be(block, 8, (uint64_t) ctx->header_done * 8);
+        cryp_aead_put_be(&block[8], 8, (uint64_t) ctx->payload_done * 8);
+    } else {
+        memcpy(block, ctx->ctr0, CRYP_AEAD_BLOCK);
+    }
+    aead_active = NULL;
+    if (cryp_gcm_ccm_final(block, tag)) {
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_aead_final(cryp_aead_t * ctx, uint8_t * tag)
+{
+    uint8_t t[CRYP_AEAD_BLOCK] __attribute__((aligned(4)));
+
+    if ((tag == NULL) || cryp_aead_tag(ctx, t)) {
+        return -1;
+    }
+    memcpy(tag, t, ctx->tag_len);
+    memset(t, 0, CRYP_AEAD_BLOCK);
+    return 0;
+}
+
+int cryp_aead_check(cryp_aead_t * ctx, const uint8_t * tag)
+{
+    uint8_t t[CRYP_AEAD_BLOCK] __attribute__((aligned(4)));
+    uint8_t diff = 0;
+    uint32_t i;
+
+    if ((tag == NULL) || cryp_aead_tag(ctx, t)) {
+        return -1;
+    }
+    for (i = 0; i < ctx->tag_len; i++) {
+        diff |= t[i] ^ tag[i];
+    }
+    memset(t, 0, CRYP_AEAD_BLOCK);
+    return diff ? -1 : 0;
+}
+
+int cryp_aead_suspend(cryp_aead_t * ctx)
+{
+    if (!cryp_aead_owned(ctx)) {
+        return -1;
+    }
+    cryp_save_context(&ctx->hw);
+    ctx->suspended = true;
+    aead_active = NULL;
+    return 0;
+}
+
+int cryp_aead_resume(cryp_aead_t * ctx)
+{
+    if ((ctx == NULL) || !ctx->suspended || (aead_active != NULL)) {
+        return -1;
+    }
+    cryp_restore_context(&ctx->hw, ctx->key, ctx->key_len);
+    ctx->suspended = false;
+    aead_active = ctx;
+    return 0;
+}
+
+static void cryp_aead_dma_done(uint32_t status)
+{
+    aead_dma.running = false;
+    cryp_release();
+    if (aead_dma.handler) {
+        aead_dma.handler((status & CRYP_DMA_STATUS_ERROR) ? -1 : 0);
+    }
+}
+
+static void cryp_aead_dma_in_handler(uint8_t irq __attribute__((unused)),
+                                     uint32_t status)
+{
+    /* header data produces no output, its transfer ends with the input */
+    if (aead_dma.running && aead_dma.header) {
+        cryp_aead_dma_done(status);
+    }
+}
+
+static void cryp_aead_dma_out_handler(uint8_t irq __attribute__((unused)),
+                                      uint32_t status)
+{
+    if (aead_dma.running && !aead_dma.header) {
+        cryp_aead_dma_done(status);
+    }
+}
+
+int cryp_aead_init_dma(int dma_in_desc, int dma_out_desc, cryp_aead_handler_t handler)
+{
+    if (aead_dma.running) {
+        goto err;
+    }
+    aead_dma.handler = handler;
+    if (cryp_init_dma(cryp_aead_dma_in_handler, cryp_aead_dma_out_handler,
+                      dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    aead_dma.ready = true;
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_aead_header_dma(cryp_aead_t * ctx, const uint8_t * data, uint32_t len)
+{
+    if (!aead_dma.ready || !cryp_aead_owned(ctx) || (data == NULL) ||
+        (len == 0) || (len % CRYP_AEAD_BLOCK)) {
+        goto err;
+    }
+    /* the staged bytes (the CCM encoded length) break the block alignment */
+    if ((ctx->blk_len > 0) || (ctx->phase > GCM_CCM_HEADER)) {
+        goto err;
+    }
+    if ((ctx->mode == AES_CCM) && (len > (ctx->header_len - ctx->header_done))) {
+        goto err;
+    }
+    if (cryp_claim_try(CRYP_PRIO_NORMAL)) {
+        goto err;
+    }
+    if (ctx->phase == GCM_CCM_INIT) {
+        cryp_gcm_ccm_phase(GCM_CCM_HEADER);
+        ctx->phase = GCM_CCM_HEADER;
+    }
+    aead_dma.header = true;
+    aead_dma.running = true;
+    aead_dma.used = true;
+    if (cryp_dma_launch_in(data, len)) {
+        aead_dma.running = false;
+        cryp_release();
+        goto err;
+    }
+    ctx->header_done += len;
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_aead_payload_dma(cryp_aead_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                          uint32_t len)
+{
+    if (!aead_dma.ready || !cryp_aead_owned(ctx) || ctx->closed ||
+        (data_in == NULL) || (data_out == NULL) || (len == 0) || (len % CRYP_AEAD_BLOCK)) {
+        goto err;
+    }
+    if ((ctx->mode == AES_CCM) && (len > (ctx->payload_len - ctx->payload_done))) {
+        goto err;
+    }
+    if (cryp_claim_try(CRYP_PRIO_NORMAL)) {
+        goto err;
+    }
+    if (cryp_aead_enter(ctx, GCM_CCM_PAYLOAD)) {
+        cryp_release();
+        goto err;
+    }
+    aead_dma.header = false;
+    aead_dma.running = true;
+    aead_dma.used = true;
+    if (cryp_dma_launch(data_in, data_out, len)) {
+        aead_dma.running = false;
+        cryp_release();
+        goto err;
+    }
+    ctx->payload_done += len;
+    return 0;
+err:
+    return -1;
+}
+
+bool cryp_aead_busy(void)
+{
+    return aead_dma.running;
+}
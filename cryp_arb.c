@@ -0,0 +1,145 @@
+#include "api/libcryp.h"
+#include "cryp_stats.h"
+
+/*
+ * Engine ownership token.
+ *
+ * A single word holds the owner class (plus one, 0 when the engine is free)
+ * in its low byte and one pending claim bit per class above. It is only
+ * changed by compare-and-swap: on the Cortex-M, LDREX/STREX, the exclusive
+ * monitor being cleared on exception entry, so that a main thread update
+ * preempted by an ISR claim fails and is retried. Each swap is a full
+ * barrier: the engine accesses of an owner are visible before the token is
+ * seen free, and those of the next owner are made after it is seen taken.
+ */
+#define CRYP_ARB_OWNER_MSK      0xffU
+#define CRYP_ARB_PENDING(prio)  ((uint32_t) 0x100U << (prio))
+
+static volatile uint32_t cryp_arb_token = 0;
+static volatile cryp_waiter_t cryp_arb_waiters[CRYP_PRIO_CLASSES] = { NULL };
+
+static inline bool cryp_arb_cas(volatile uint32_t * word, uint32_t old, uint32_t val)
+{
+#if defined(__arm__)
+    uint32_t cur;
+    uint32_t failed;
+
+    __asm__ volatile ("ldrex %0, [%1]" : "=r" (cur) : "r" (word) : "memory");
+    if (cur != old) {
+        __asm__ volatile ("clrex" ::: "memory");
+        return false;
+    }
+    /* release: order the owner's accesses before the token update */
+    __asm__ volatile ("dmb" ::: "memory");
+    __asm__ volatile ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (word), "r" (val) : "memory");
+    /* acquire: no access of the new owner before the token is taken */
+    __asm__ volatile ("dmb" ::: "memory");
+    return failed == 0;
+#else
+    return __atomic_compare_exchange_n(word, &old, val, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* pending claims of the classes above prio */
+static inline uint32_t cryp_arb_above(uint32_t token, enum cryp_prio prio)
+{
+    return token & ~(CRYP_ARB_PENDING(prio + 1) - 1);
+}
+
+int cryp_claim(enum cryp_prio prio)
+{
+    uint32_t token;
+
+    if (prio >= CRYP_PRIO_CLASSES) {
+        return -1;
+    }
+    for (;;) {
+        token = cryp_arb_token;
+        if (((token & CRYP_ARB_OWNER_MSK) == 0) && !cryp_arb_above(token, prio)) {
+            if (cryp_arb_cas(&cryp_arb_token, token,
+                             (token & ~CRYP_ARB_PENDING(prio)) | ((uint32_t) prio + 1))) {
+                break;
+            }
+        } else if (token & CRYP_ARB_PENDING(prio)) {
+            return -1;
+        } else if (cryp_arb_cas(&cryp_arb_token, token, token | CRYP_ARB_PENDING(prio))) {
+            cryp_stats_contended(prio);
+            return -1;
+        }
+    }
+    cryp_stats_hold_begin(prio);
+    return 0;
+}
+
+int cryp_claim_try(enum cryp_prio prio)
+{
+    uint32_t token;
+
+    if (prio >= CRYP_PRIO_CLASSES) {
+        return -1;
+    }
+    do {
+        token = cryp_arb_token;
+        if (((token & CRYP_ARB_OWNER_MSK) != 0) || cryp_arb_above(token, prio)) {
+            return -1;
+        }
+    } while (!cryp_arb_cas(&cryp_arb_token, token,
+                           (token & ~CRYP_ARB_PENDING(prio)) | ((uint32_t) prio + 1)));
+    cryp_stats_hold_begin(prio);
+    return 0;
+}
+
+void cryp_claim_cancel(enum cryp_prio prio)
+{
+    uint32_t token;
+
+    do {
+        token = cryp_arb_token;
+    } while (!cryp_arb_cas(&cryp_arb_token, token, token & ~CRYP_ARB_PENDING(prio)));
+}
+
+void cryp_release(void)
+{
+    uint32_t token;
+    cryp_waiter_t waiter;
+    uint32_t prio;
+
+    do {
+        token = cryp_arb_token;
+        if ((token & CRYP_ARB_OWNER_MSK) == 0) {
+            return;
+        }
+    } while (!cryp_arb_cas(&cryp_arb_token, token, token & ~CRYP_ARB_OWNER_MSK));
+    cryp_stats_hold_end((enum cryp_prio) ((token & CRYP_ARB_OWNER_MSK) - 1));
+
+    /* highest class first, until a waiter has taken the engine */
+    for (prio = CRYP_PRIO_CLASSES; prio-- > 0; ) {
+        waiter = cryp_arb_waiters[prio];
+        if (waiter == NULL) {
+            continue;
+        }
+        cryp_arb_waiters[prio] = NULL;
+        waiter();
+        if (cryp_arb_token & CRYP_ARB_OWNER_MSK) {
+            break;
+        }
+    }
+}
+
+bool cryp_claim_pending(enum cryp_prio prio)
+{
+    return cryp_arb_above(cryp_arb_token, prio) != 0;
+}
+
+int cryp_claim_notify(enum cryp_prio prio, cryp_waiter_t waiter)
+{
+    if ((prio >= CRYP_PRIO_CLASSES) || (waiter == NULL)) {
+        return -1;
+    }
+    if ((cryp_arb_waiters[prio] != NULL) && (cryp_arb_waiters[prio] != waiter)) {
+        /* another waiter of this class has not been called yet */
+        return -1;
+    }
+    cryp_arb_waiters[prio] = waiter;
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+#if CONFIG_USR_DRV_CRYP_SOFT
+/*
+ * Hardware/software dispatcher.
+ *
+ * A request goes to the Cryp core when it is mapped and idle. Otherwise, a
+ * request up to CONFIG_USR_DRV_CRYP_SOFT_MAX bytes is (de)crypted in
+ * software, which is cheaper than the map and unmap syscalls, while a bigger
+ * one maps the device for its duration (falling back to software if the
+ * device can not be mapped). The hardware path owns the engine as
+ * CRYP_PRIO_NORMAL for the request: when it can not be claimed (queue,
+ * stream or DMA transfer running, or a claim pending), the request is done
+ * in software.
+ * The software key schedule is only done by the first software request.
+ */
+
+static inline bool cryp_auto_has_iv(enum crypto_algo mode)
+{
+    return (mode == AES_CBC) || (mode == AES_CTR) || (mode == DES_CBC) || (mode == TDES_CBC);
+}
+
+static inline uint32_t cryp_auto_block(enum crypto_algo mode)
+{
+    return ((mode == AES_ECB) || (mode == AES_CBC) || (mode == AES_CTR)) ? 16 : 8;
+}
+
+/*
+ * the core is not busy with an asynchronous transfer of this library, be
+ * it an owner of the engine or not
+ */
+static bool cryp_auto_hw_idle(void)
+{
+#if CONFIG_USR_DRV_CRYP_IRQ
+    if (cryp_async_busy()) {
+        return false;
+    }
+#endif
+    return (cryp_queue_pending() == 0) && (cryp_stream_pending() == 0) &&
+           !cryp_sg_busy() && !cryp_sector_busy() && !cryp_aead_busy();
+}
+
+int cryp_auto_init(cryp_auto_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * iv, unsigned int iv_len,
+                   enum crypto_algo mode, enum crypto_dir dir)
+{
+    if ((ctx == NULL) || (mode > AES_CTR)) {
+        goto err;
+    }
+    memset(ctx, 0, sizeof(cryp_auto_t));
+    if (cryp_auto_has_iv(mode)) {
+        if ((iv == NULL) || (iv_len != cryp_auto_block(mode))) {
+            goto err;
+        }
+        memcpy(ctx->iv, iv, iv_len);
+        ctx->iv_len = iv_len;
+    }
+    ctx->key = key;
+    ctx->key_len = key_len;
+    ctx->mode = mode;
+    ctx->dir = dir;
+    ctx->last = CRYP_BACKEND_NONE;
+    return 0;
+err:
+    return -1;
+}
+
+static int cryp_auto_do_soft(cryp_auto_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                             uint32_t data_len)
+{
+    if (!ctx->soft_ready) {
+        if (cryp_soft_init(&ctx->soft, ctx->key, ctx->key_len, NULL, 0, ctx->mode, ctx->dir)) {
+            return -1;
+        }
+        ctx->soft_ready = true;
+    }
+    memcpy(ctx->soft.iv, ctx->iv, ctx->iv_len);
+    if (cryp_soft_do(&ctx->soft, data_in, data_out, data_len)) {
+        return -1;
+    }
+    cryp_soft_get_iv(&ctx->soft, ctx->iv, ctx->iv_len);
+    ctx->last = CRYP_BACKEND_SOFT;
+    return 0;
+}
+
+static int cryp_auto_do_hw(cryp_auto_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                           uint32_t data_len)
+{
+    cryp_init(ctx->key, ctx->key_len, ctx->iv_len ? ctx->iv : NULL, ctx->iv_len,
+              ctx->mode, ctx->dir);
+    if (cryp_do_no_dma(data_in, data_out, data_len)) {
+        return -1;
+    }
+    if (ctx->iv_len) {
+        cryp_get_iv(ctx->iv, ctx->iv_len);
+    }
+    ctx->last = CRYP_BACKEND_HW;
+    return 0;
+}
+
+int cryp_auto_do(cryp_auto_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                 uint32_t data_len)
+{
+    bool hw, soft;
+    int ret;
+
+    if ((ctx == NULL) || (data_len % cryp_auto_block(ctx->mode)) ||
+        ((data_len > 0) && ((data_in == NULL) || (data_out == NULL)))) {
+        goto err;
+    }
+    if (data_len == 0) {
+        return 0;
+    }
+    hw = cryp_auto_hw_idle();
+    /* the key in place in the core can not be read back */
+    soft = (ctx->key != NULL);
+
+    /* a mapped (or lingering) device costs no map syscall */
+    if (hw && (cryp_mapped() || !soft || (data_len > CONFIG_USR_DRV_CRYP_SOFT_MAX)) &&
+        (cryp_claim_try(CRYP_PRIO_NORMAL) == 0)) {
+        if (cryp_map_get() == 0) {
+            ret = cryp_auto_do_hw(ctx, data_in, data_out, data_len);
+            cryp_map_put();
+            cryp_release();
+            return ret;
+        }
+        cryp_release();
+    }
+    if (soft) {
+        return cryp_auto_do_soft(ctx, data_in, data_out, data_len);
+    }
+#if CONFIG_USR_DRV_CRYP_DEBUG
+    printf("Error: CRYP, no backend available for this request!\n");
+#endif
+err:
+    return -1;
+}
+
+void cryp_auto_release(cryp_auto_t * ctx)
+{
+    if (ctx != NULL) {
+        cryp_soft_wipe(&ctx->soft);
+        ctx->soft_ready = false;
+    }
+}
+#endif
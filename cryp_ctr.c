@@ -0,0 +1,162 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * AES-CTR streams.
+ *
+ * The counter block of the stream block n is the initial counter block plus
+ * n, on 128 bits. The Cryp core only increments the 32 least significant
+ * bits of its counter, so the whole blocks of an update are (de)crypted in
+ * runs that never cross a 2^32 boundary of the low counter word, the counter
+ * block being computed and reloaded at the start of each run. A partial
+ * block is (de)crypted through a local block, whose keystream is kept for the
+ * next update (or for a seek inside the same block).
+ */
+
+#define CRYP_CTR_BLOCK      16
+
+/* @ctr = @iv + @block, on 128 bits, big endian */
+static void cryp_ctr_block(const uint8_t * iv, uint64_t block, uint8_t * ctr)
+{
+    uint32_t carry = 0;
+    int i;
+
+    for (i = CRYP_CTR_BLOCK - 1; i >= 0; i--) {
+        carry += iv[i] + (uint32_t)(block & 0xff);
+        ctr[i] = (uint8_t)carry;
+        carry >>= 8;
+        block >>= 8;
+    }
+}
+
+/* (de)crypt @nblocks whole blocks, starting at the stream block @block */
+static int cryp_ctr_run(const cryp_ctr_t * ctx, uint64_t block,
+                        const uint8_t * in, uint8_t * out, uint32_t nblocks)
+{
+    uint8_t ctr[CRYP_CTR_BLOCK] __attribute__((aligned(4)));
+    uint32_t low;
+    uint64_t run;
+
+    while (nblocks > 0) {
+        cryp_ctr_block(ctx->iv, block, ctr);
+        /* blocks before the hardware 32 bits counter wraps */
+        low = ((uint32_t)ctr[12] << 24) | ((uint32_t)ctr[13] << 16) |
+              ((uint32_t)ctr[14] << 8) | ctr[15];
+        run = 0x100000000ULL - low;
+        if (run > nblocks) {
+            run = nblocks;
+        }
+        cryp_init(ctx->key, ctx->key_len, ctr, CRYP_CTR_BLOCK, AES_CTR, ENCRYPT);
+        if (cryp_do_no_dma(in, out, (uint32_t)run * CRYP_CTR_BLOCK)) {
+            goto err;
+        }
+        in += run * CRYP_CTR_BLOCK;
+        out += run * CRYP_CTR_BLOCK;
+        block += run;
+        nblocks -= (uint32_t)run;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+/* compute the keystream of the block holding the current offset */
+static int cryp_ctr_keystream(cryp_ctr_t * ctx)
+{
+    uint8_t zero[CRYP_CTR_BLOCK] __attribute__((aligned(4)));
+
+    memset(zero, 0, CRYP_CTR_BLOCK);
+    if (cryp_ctr_run(ctx, ctx->offset / CRYP_CTR_BLOCK, zero, ctx->ks, 1)) {
+        ctx->ks_valid = false;
+        return -1;
+    }
+    ctx->ks_valid = true;
+    return 0;
+}
+
+int cryp_ctr_init(cryp_ctr_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                  const uint8_t * iv)
+{
+    if ((ctx == NULL) || (iv == NULL)) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(cryp_ctr_t));
+    ctx->key = key;
+    ctx->key_len = key_len;
+    memcpy(ctx->iv, iv, CRYP_CTR_BLOCK);
+    return 0;
+}
+
+int cryp_ctr_update(cryp_ctr_t * ctx, const uint8_t * in, uint8_t * out, uint32_t len)
+{
+    uint32_t pos, n, i;
+
+    if ((ctx == NULL) || ((len > 0) && ((in == NULL) || (out == NULL)))) {
+        goto err;
+    }
+
+    /* use up the keystream of a partially consumed block */
+    pos = (uint32_t)(ctx->offset % CRYP_CTR_BLOCK);
+    if ((pos != 0) && (len > 0)) {
+        if (!ctx->ks_valid && cryp_ctr_keystream(ctx)) {
+            goto err;
+        }
+        n = CRYP_CTR_BLOCK - pos;
+        if (n > len) {
+            n = len;
+        }
+        for (i = 0; i < n; i++) {
+            out[i] = in[i] ^ ctx->ks[pos + i];
+        }
+        in += n;
+        out += n;
+        len -= n;
+        ctx->offset += n;
+        if ((ctx->offset % CRYP_CTR_BLOCK) == 0) {
+            ctx->ks_valid = false;
+        }
+    }
+
+    /* whole blocks go straight through the engine */
+    n = len / CRYP_CTR_BLOCK;
+    if (n > 0) {
+        if (cryp_ctr_run(ctx, ctx->offset / CRYP_CTR_BLOCK, in, out, n)) {
+            goto err;
+        }
+        in += n * CRYP_CTR_BLOCK;
+        out += n * CRYP_CTR_BLOCK;
+        len -= n * CRYP_CTR_BLOCK;
+        ctx->offset += n * CRYP_CTR_BLOCK;
+        ctx->ks_valid = false;
+    }
+
+    /* tail: keep the rest of its keystream for the next update */
+    if (len > 0) {
+        if (!ctx->ks_valid && cryp_ctr_keystream(ctx)) {
+            goto err;
+        }
+        for (i = 0; i < len; i++) {
+            out[i] = in[i] ^ ctx->ks[i];
+        }
+        ctx->offset += len;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_ctr_seek(cryp_ctr_t * ctx, uint64_t offset)
+{
+    if (ctx == NULL) {
+        return -1;
+    }
+    /* the keystream is kept when staying in the same block */
+    if ((offset / CRYP_CTR_BLOCK) != (ctx->offset / CRYP_CTR_BLOCK)) {
+        ctx->ks_valid = false;
+    }
+    ctx->offset = offset;
+    return 0;
+}
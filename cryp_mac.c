@@ -0,0 +1,157 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * AES MACs.
+ *
+ * CBC-MAC and CMAC are AES-CBC encryptions of the message with a zero IV,
+ * the MAC being the last ciphertext block. Whole blocks go through the
+ * engine in direct access mode, the output FIFO being drained into a scratch
+ * word (cryp_absorb_no_dma()), and the chaining value is read back from the
+ * IV registers after each update, so that the engine can be used by others
+ * between two updates. The last block of the message is only known at
+ * cryp_mac_final(), so that an update always keeps its last block (even a
+ * whole one) in the context.
+ */
+
+#define CRYP_MAC_BLOCK      16
+
+/* CMAC subkey doubling in GF(2^128) */
+static void cryp_mac_dbl(const uint8_t * in, uint8_t * out)
+{
+    uint8_t msb = in[0] & 0x80;
+    int i;
+
+    for (i = 0; i < CRYP_MAC_BLOCK - 1; i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[CRYP_MAC_BLOCK - 1] = (uint8_t)((in[CRYP_MAC_BLOCK - 1] << 1) ^ (msb ? 0x87 : 0));
+}
+
+/* CBC-encrypt @len bytes (whole blocks) into the chaining value */
+static int cryp_mac_absorb(cryp_mac_t * ctx, const uint8_t * data, uint32_t len)
+{
+    cryp_init(ctx->key, ctx->key_len, ctx->chain, CRYP_MAC_BLOCK, AES_CBC, ENCRYPT);
+    if (cryp_absorb_no_dma(data, len)) {
+        return -1;
+    }
+    cryp_get_iv(ctx->chain, CRYP_MAC_BLOCK);
+    return 0;
+}
+
+int cryp_mac_init(cryp_mac_t * ctx, enum cryp_mac_type type,
+                  const uint8_t * key, enum crypto_key_len key_len)
+{
+    uint8_t l[CRYP_MAC_BLOCK] __attribute__((aligned(4)));
+
+    if ((ctx == NULL) || ((type != CRYP_MAC_CBC) && (type != CRYP_MAC_CMAC))) {
+        goto err;
+    }
+    memset(ctx, 0, sizeof(cryp_mac_t));
+    ctx->type = type;
+    ctx->key = key;
+    ctx->key_len = key_len;
+
+    if (type == CRYP_MAC_CMAC) {
+        /* L = AES(K, 0^128), K1 = dbl(L), K2 = dbl(K1) */
+        memset(l, 0, CRYP_MAC_BLOCK);
+        cryp_init(key, key_len, NULL, 0, AES_ECB, ENCRYPT);
+        if (cryp_do_no_dma(l, l, CRYP_MAC_BLOCK)) {
+            goto err;
+        }
+        cryp_mac_dbl(l, ctx->k1);
+        cryp_mac_dbl(ctx->k1, ctx->k2);
+        memset(l, 0, CRYP_MAC_BLOCK);
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_mac_update(cryp_mac_t * ctx, const uint8_t * data, uint32_t len)
+{
+    uint32_t n;
+
+    if ((ctx == NULL) || ((len > 0) && (data == NULL))) {
+        goto err;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    /* complete the pending block, absorbing it if more data follows */
+    if (ctx->blk_len > 0) {
+        n = CRYP_MAC_BLOCK - ctx->blk_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&ctx->blk[ctx->blk_len], data, n);
+        ctx->blk_len += n;
+        data += n;
+        len -= n;
+        if (len == 0) {
+            return 0;
+        }
+        if (cryp_mac_absorb(ctx, ctx->blk, CRYP_MAC_BLOCK)) {
+            goto err;
+        }
+        ctx->blk_len = 0;
+    }
+
+    /* whole blocks straight from the caller buffer, but the last one */
+    n = (len - 1) - ((len - 1) % CRYP_MAC_BLOCK);
+    if (n > 0) {
+        if (cryp_mac_absorb(ctx, data, n)) {
+            goto err;
+        }
+        data += n;
+        len -= n;
+    }
+    memcpy(ctx->blk, data, len);
+    ctx->blk_len = len;
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_mac_final(cryp_mac_t * ctx, uint8_t * mac)
+{
+    const uint8_t *k;
+    uint32_t i;
+
+    if ((ctx == NULL) || (mac == NULL)) {
+        goto err;
+    }
+    if ((ctx->type == CRYP_MAC_CBC) && (ctx->blk_len == 0)) {
+        /* nothing pending: the MAC is the current chaining value */
+        goto out;
+    }
+    if (ctx->blk_len < CRYP_MAC_BLOCK) {
+        memset(&ctx->blk[ctx->blk_len], 0, CRYP_MAC_BLOCK - ctx->blk_len);
+    }
+    if (ctx->type == CRYP_MAC_CMAC) {
+        /* complete block: M ^ K1, otherwise (M || 10*) ^ K2 */
+        if (ctx->blk_len < CRYP_MAC_BLOCK) {
+            ctx->blk[ctx->blk_len] = 0x80;
+            k = ctx->k2;
+        } else {
+            k = ctx->k1;
+        }
+        for (i = 0; i < CRYP_MAC_BLOCK; i++) {
+            ctx->blk[i] ^= k[i];
+        }
+    }
+    if (cryp_mac_absorb(ctx, ctx->blk, CRYP_MAC_BLOCK)) {
+        goto err;
+    }
+out:
+    memcpy(mac, ctx->chain, CRYP_MAC_BLOCK);
+    /* the context holds key material */
+    memset(ctx, 0, sizeof(cryp_mac_t));
+    return 0;
+err:
+    return -1;
+}
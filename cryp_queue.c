@@ -0,0 +1,192 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Asynchronous CRYP job queue.
+ *
+ * Each job carries its own Cryp configuration and buffers. Jobs are executed
+ * back to back by the DMA: the output DMA completion of a job programs and
+ * starts the next one, then calls the completed job handler. The Cryp engine
+ * is only reconfigured when the job configuration differs from the loaded
+ * one, and only the IV is reloaded when nothing else changes.
+ *
+ * As for the streaming stage, the ring head is only moved by the DMA handler
+ * and the ring tail by the task main thread.
+ *
+ * The queue owns the engine as CRYP_PRIO_BULK while it runs. When a higher
+ * class claim is pending at a job boundary, the queue pauses and releases
+ * the engine, and is resumed by the release of the claimer: the next job is
+ * then fully reconfigured.
+ */
+
+static cryp_job_t queue_ring[CRYP_QUEUE_DEPTH];
+static volatile uint32_t queue_head = 0;
+static volatile uint32_t queue_tail = 0;
+static volatile bool queue_running = false;
+static volatile bool queue_paused = false;
+
+/* Cryp configuration loaded by the previous job */
+static struct {
+    bool                valid;
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+} queue_cfg = { false, NULL, KEY_128, AES_ECB, ENCRYPT };
+
+static int cryp_queue_start(const cryp_job_t *job)
+{
+    if (!queue_cfg.valid ||
+        (job->key != queue_cfg.key) ||
+        (job->key_len != queue_cfg.key_len) ||
+        (job->mode != queue_cfg.mode) ||
+        (job->dir != queue_cfg.dir)) {
+        cryp_init(job->key, job->key_len, job->iv, job->iv_len, job->mode, job->dir);
+        queue_cfg.key = job->key;
+        queue_cfg.key_len = job->key_len;
+        queue_cfg.mode = job->mode;
+        queue_cfg.dir = job->dir;
+        queue_cfg.valid = true;
+    } else if (job->iv) {
+        cryp_reload_iv(job->iv, job->iv_len);
+    }
+    return cryp_dma_launch(job->bufin, job->bufout, job->size);
+}
+
+/*
+ * start the job at the ring head, dropping the ones that fail to start.
+ * The engine is released when no job is left.
+ */
+static void cryp_queue_chain(void)
+{
+    cryp_job_t *next;
+
+    while (queue_tail != queue_head) {
+        next = &queue_ring[queue_head % CRYP_QUEUE_DEPTH];
+        if (cryp_queue_start(next) == 0) {
+            return;
+        }
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP queue, unable to start job!\n");
+#endif
+        /* drop the failing job and try the following one */
+        queue_cfg.valid = false;
+        queue_head++;
+        if (next->handler) {
+            next->handler(-1, next);
+        }
+    }
+    queue_running = false;
+    cryp_release();
+}
+
+/* called by cryp_release() while paused */
+static void cryp_queue_resume(void)
+{
+    if (cryp_claim(CRYP_PRIO_BULK)) {
+        cryp_claim_notify(CRYP_PRIO_BULK, cryp_queue_resume);
+        return;
+    }
+    /* the claimer may have used the engine in any way */
+    queue_cfg.valid = false;
+    queue_paused = false;
+    queue_running = true;
+    cryp_queue_chain();
+}
+
+static void cryp_queue_dma_out_handler(uint8_t irq __attribute__((unused)),
+                                       uint32_t status)
+{
+    cryp_job_t *job;
+
+    if (!queue_running) {
+        return;
+    }
+    job = &queue_ring[queue_head % CRYP_QUEUE_DEPTH];
+    queue_head++;
+
+    /* chain the next job before handing the completed one back */
+    if ((queue_tail != queue_head) && cryp_claim_pending(CRYP_PRIO_BULK)) {
+        queue_running = false;
+        queue_paused = true;
+        cryp_claim_notify(CRYP_PRIO_BULK, cryp_queue_resume);
+        cryp_release();
+    } else {
+        cryp_queue_chain();
+    }
+
+    if (job->handler) {
+        job->handler((status & CRYP_DMA_STATUS_ERROR) ? -1 : 0, job);
+    }
+}
+
+int cryp_queue_init(int dma_in_desc, int dma_out_desc)
+{
+    if (queue_running || queue_paused) {
+        goto err;
+    }
+    queue_head = 0;
+    queue_tail = 0;
+    queue_cfg.valid = false;
+
+    if (cryp_init_dma(NULL, cryp_queue_dma_out_handler, dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_queue_submit(const cryp_job_t * job)
+{
+    if (job == NULL) {
+        goto err;
+    }
+    if ((queue_tail - queue_head) >= CRYP_QUEUE_DEPTH) {
+        /* queue is full */
+        goto err;
+    }
+    memcpy(&queue_ring[queue_tail % CRYP_QUEUE_DEPTH], job, sizeof(cryp_job_t));
+    queue_tail++;
+
+    /* when idle, no DMA handler can be executed until we start the job */
+    if (!queue_running && !queue_paused) {
+        if (cryp_claim(CRYP_PRIO_BULK)) {
+            /* started by the release of the current owner */
+            if (cryp_claim_notify(CRYP_PRIO_BULK, cryp_queue_resume)) {
+                cryp_claim_cancel(CRYP_PRIO_BULK);
+                queue_tail--;
+                goto err;
+            }
+            queue_paused = true;
+            return 0;
+        }
+        queue_running = true;
+        if (cryp_queue_start(&queue_ring[queue_head % CRYP_QUEUE_DEPTH])) {
+            queue_cfg.valid = false;
+            queue_running = false;
+            queue_tail--;
+            cryp_release();
+            goto err;
+        }
+    }
+    return 0;
+err:
+    return -1;
+}
+
+uint32_t cryp_queue_pending(void)
+{
+    return queue_tail - queue_head;
+}
+
+void cryp_queue_invalidate(void)
+{
+    queue_cfg.valid = false;
+}
@@ -9,6 +9,10 @@
 /* The CRYP base is common to USER and CFG */
 #define CRYP_BASE			CRYP_USER_BASE
 
+#ifndef CRYP_IRQ
+# define CRYP_IRQ			95	/* IRQ 79 + 16 */
+#endif
+
 #define r_CORTEX_M_CRYP_CR		REG_ADDR(CRYP_BASE + 0x00)
 #define r_CORTEX_M_CRYP_SR		REG_ADDR(CRYP_BASE + 0x04)
 #define r_CORTEX_M_CRYP_DIN		REG_ADDR(CRYP_BASE + 0x08)
@@ -21,6 +25,9 @@
 #define r_CORTEX_M_CRYP_KxRR(n)	REG_ADDR(CRYP_BASE + 0x24 + ((n) * 8))
 #define r_CORTEX_M_CRYP_IVxLR(n)	REG_ADDR(CRYP_BASE + 0x40 + ((n) * 8))
 #define r_CORTEX_M_CRYP_IVxRR(n)	REG_ADDR(CRYP_BASE + 0x44 + ((n) * 8))
+/* GCM/CCM context swap registers (STM32F42x/F43x only) */
+#define r_CORTEX_M_CRYP_CSGCMCCMxR(n)	REG_ADDR(CRYP_BASE + 0x50 + ((n) * 4))
+#define r_CORTEX_M_CRYP_CSGCMxR(n)	REG_ADDR(CRYP_BASE + 0x70 + ((n) * 4))
 
 /* CRYP control register */
 #define CRYP_CR_ALGODIR_Pos	2
@@ -37,6 +44,9 @@
 #	define CRYP_CR_ALGOMODE_AES_CBC		5
 #	define CRYP_CR_ALGOMODE_AES_CTR		6
 #	define CRYP_CR_ALGOMODE_AES_KEY_PREPARE	7
+/* ALGOMODE[3], STM32F42x/F43x only: GCM is 0b1000, CCM is 0b1001 */
+#define CRYP_CR_ALGOMODE3_Pos	19
+#define CRYP_CR_ALGOMODE3_Msk	((uint32_t)0x1 << CRYP_CR_ALGOMODE3_Pos)
 #define CRYP_CR_DATATYPE_Pos	6
 #define CRYP_CR_DATATYPE_Msk	((uint32_t)0x3 << CRYP_CR_DATATYPE_Pos)
 #	define CRYP_CR_DATATYPE_WORDS		0
@@ -52,6 +62,12 @@
 #define CRYP_CR_FFLUSH_Msk	((uint32_t)1 << CRYP_CR_FFLUSH_Pos)
 #define CRYP_CR_CRYPEN_Pos	15
 #define CRYP_CR_CRYPEN_Msk	((uint32_t)1 << CRYP_CR_CRYPEN_Pos)
+#define CRYP_CR_GCM_CCMPH_Pos	16
+#define CRYP_CR_GCM_CCMPH_Msk	((uint32_t)0x3 << CRYP_CR_GCM_CCMPH_Pos)
+#	define CRYP_CR_GCM_CCMPH_INIT		0
+#	define CRYP_CR_GCM_CCMPH_HEADER		1
+#	define CRYP_CR_GCM_CCMPH_PAYLOAD	2
+#	define CRYP_CR_GCM_CCMPH_FINAL		3
 
 /* CRYP status register */
 #define CRYP_SR_IFEM_Pos	0
@@ -0,0 +1,272 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Sector batches.
+ *
+ * A run of sectors is (de)crypted sector by sector, each sector with its own
+ * IV derived from its sector number. The Cryp engine is configured once per
+ * batch of CRYP_SECTOR_IV_BATCH sectors, and only the IV registers are
+ * reloaded between two sectors of a batch. With DMA, the streams are prepared
+ * once by cryp_sector_init(), and the output DMA completion of a sector
+ * reloads the IV and relaunches the streams on the next sector, so that a
+ * whole run is a single submission.
+ *
+ * ESSIV IVs of a batch are derived at once, in a single AES ECB pass over
+ * the plain IVs with the ESSIV key, before the data key is loaded back.
+ */
+
+static struct {
+    bool                valid;
+    const uint8_t      *key;
+    enum crypto_key_len key_len;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    enum cryp_sector_iv iv_gen;
+    const uint8_t      *essiv_key;
+    enum crypto_key_len essiv_key_len;
+} sector_cfg = { false, NULL, KEY_128, AES_CBC, ENCRYPT, CRYP_SECTOR_IV_PLAIN, NULL, KEY_128 };
+
+/* IVs of the current batch */
+static uint8_t  sector_iv[CRYP_SECTOR_IV_BATCH][16] __attribute__((aligned(4)));
+static uint32_t sector_iv_cur = 0;
+static uint32_t sector_iv_cnt = 0;
+
+static struct {
+    volatile bool         running;
+    cryp_sector_handler_t handler;
+    uint64_t              first;
+    uint64_t              lba;
+    uint32_t              sector_size;
+    uint32_t              left;
+    const uint8_t        *in;
+    uint8_t              *out;
+} sector_dma = { false, NULL, 0, 0, 0, 0, NULL, NULL };
+
+static inline bool cryp_sector_is_aes(enum crypto_algo mode)
+{
+    return (mode == AES_ECB) || (mode == AES_CBC) || (mode == AES_CTR);
+}
+
+static inline uint32_t cryp_sector_iv_len(void)
+{
+    return cryp_sector_is_aes(sector_cfg.mode) ? 16 : 8;
+}
+
+static inline bool cryp_sector_has_iv(void)
+{
+    return (sector_cfg.mode != AES_ECB) && (sector_cfg.mode != DES_ECB) &&
+           (sector_cfg.mode != TDES_ECB);
+}
+
+int cryp_sector_setup(const uint8_t * key, enum crypto_key_len key_len,
+                      enum crypto_algo mode, enum crypto_dir dir,
+                      enum cryp_sector_iv iv_gen,
+                      const uint8_t * essiv_key, enum crypto_key_len essiv_key_len)
+{
+    if (sector_dma.running || (mode == AES_KEY_PREPARE) ||
+        (mode == AES_GCM) || (mode == AES_CCM)) {
+        goto err;
+    }
+    if (iv_gen == CRYP_SECTOR_IV_ESSIV) {
+        /* the data key must be reloaded after each IV derivation */
+        if ((key == NULL) || (essiv_key == NULL) || !cryp_sector_is_aes(mode)) {
+            goto err;
+        }
+    } else if (iv_gen != CRYP_SECTOR_IV_PLAIN) {
+        goto err;
+    }
+    sector_cfg.key = key;
+    sector_cfg.key_len = key_len;
+    sector_cfg.mode = mode;
+    sector_cfg.dir = dir;
+    sector_cfg.iv_gen = iv_gen;
+    sector_cfg.essiv_key = essiv_key;
+    sector_cfg.essiv_key_len = essiv_key_len;
+    sector_cfg.valid = true;
+    sector_iv_cur = sector_iv_cnt = 0;
+    return 0;
+err:
+    return -1;
+}
+
+/*
+ * derive the IVs of the @count (at most CRYP_SECTOR_IV_BATCH) sectors from
+ * @lba, and configure the engine for the first one
+ */
+static int cryp_sector_batch(uint64_t lba, uint32_t count)
+{
+    uint32_t iv_len = cryp_sector_iv_len();
+    uint32_t i, j;
+
+    if (count > CRYP_SECTOR_IV_BATCH) {
+        count = CRYP_SECTOR_IV_BATCH;
+    }
+    for (i = 0; i < count; i++) {
+        memset(sector_iv[i], 0, iv_len);
+        for (j = 0; j < 8; j++) {
+            sector_iv[i][j] = (uint8_t)((lba + i) >> (8 * j));
+        }
+    }
+    if (sector_cfg.iv_gen == CRYP_SECTOR_IV_ESSIV) {
+        /* no DMA request must be pending while feeding the FIFOs by hand */
+        cryp_disable_dma();
+        cryp_init(sector_cfg.essiv_key, sector_cfg.essiv_key_len, NULL, 0, AES_ECB, ENCRYPT);
+        if (cryp_do_no_dma(sector_iv[0], sector_iv[0], count * 16)) {
+            goto err;
+        }
+    }
+    cryp_init(sector_cfg.key, sector_cfg.key_len,
+              cryp_sector_has_iv() ? sector_iv[0] : NULL, iv_len,
+              sector_cfg.mode, sector_cfg.dir);
+    sector_iv_cur = 0;
+    sector_iv_cnt = count;
+    return 0;
+err:
+    sector_iv_cur = sector_iv_cnt = 0;
+    return -1;
+}
+
+/* load the IV of the sector @lba, @left sectors remaining in the run */
+static int cryp_sector_load(uint64_t lba, uint32_t left)
+{
+    if (++sector_iv_cur >= sector_iv_cnt) {
+        return cryp_sector_batch(lba, left);
+    }
+    if (cryp_sector_has_iv()) {
+        cryp_reload_iv(sector_iv[sector_iv_cur], cryp_sector_iv_len());
+    }
+    return 0;
+}
+
+static int cryp_sector_check(uint32_t sector_size, uint32_t count,
+                             const uint8_t * bufin, uint8_t * bufout)
+{
+    if (!sector_cfg.valid || (count == 0) || (bufin == NULL) || (bufout == NULL)) {
+        return -1;
+    }
+    if ((sector_size == 0) || (sector_size % cryp_sector_iv_len())) {
+        /* sectors are made of whole blocks */
+        return -1;
+    }
+    return 0;
+}
+
+int cryp_do_sectors_no_dma(uint64_t lba, uint32_t sector_size, uint32_t count,
+                           const uint8_t * bufin, uint8_t * bufout)
+{
+    if (sector_dma.running || cryp_sector_check(sector_size, count, bufin, bufout)) {
+        goto err;
+    }
+    if (cryp_sector_batch(lba, count)) {
+        goto err;
+    }
+    while (1) {
+        if (cryp_do_no_dma(bufin, bufout, sector_size)) {
+            goto err;
+        }
+        bufin += sector_size;
+        bufout += sector_size;
+        lba++;
+        if (--count == 0) {
+            break;
+        }
+        if (cryp_sector_load(lba, count)) {
+            goto err;
+        }
+    }
+    return 0;
+err:
+    return -1;
+}
+
+static void cryp_sector_dma_out_handler(uint8_t irq __attribute__((unused)),
+                                        uint32_t status)
+{
+    int ret = 0;
+
+    if (!sector_dma.running) {
+        return;
+    }
+    if (status & CRYP_DMA_STATUS_ERROR) {
+        /* the current sector is not complete, it is not counted */
+        ret = -1;
+        goto end;
+    }
+    sector_dma.in += sector_dma.sector_size;
+    sector_dma.out += sector_dma.sector_size;
+    sector_dma.lba++;
+    sector_dma.left--;
+
+    if (sector_dma.left > 0) {
+        if ((cryp_sector_load(sector_dma.lba, sector_dma.left) == 0) &&
+            (cryp_dma_launch(sector_dma.in, sector_dma.out, sector_dma.sector_size) == 0)) {
+            return;
+        }
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP sectors, unable to start sector!\n");
+#endif
+        ret = -1;
+    }
+end:
+    sector_dma.running = false;
+    cryp_release();
+    if (sector_dma.handler) {
+        sector_dma.handler(ret, sector_dma.first, (uint32_t)(sector_dma.lba - sector_dma.first));
+    }
+}
+
+int cryp_sector_init(int dma_in_desc, int dma_out_desc, cryp_sector_handler_t handler)
+{
+    if (sector_dma.running) {
+        goto err;
+    }
+    sector_dma.handler = handler;
+    if (cryp_init_dma(NULL, cryp_sector_dma_out_handler, dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_do_sectors_dma(uint64_t lba, uint32_t sector_size, uint32_t count,
+                        const uint8_t * bufin, uint8_t * bufout)
+{
+    if (sector_dma.running || cryp_sector_check(sector_size, count, bufin, bufout)) {
+        goto err;
+    }
+    if (cryp_claim_try(CRYP_PRIO_NORMAL)) {
+        goto err;
+    }
+    if (cryp_sector_batch(lba, count)) {
+        cryp_release();
+        goto err;
+    }
+    sector_dma.first = lba;
+    sector_dma.lba = lba;
+    sector_dma.sector_size = sector_size;
+    sector_dma.left = count;
+    sector_dma.in = bufin;
+    sector_dma.out = bufout;
+    sector_dma.running = true;
+    if (cryp_dma_launch(bufin, bufout, sector_size)) {
+        sector_dma.running = false;
+        cryp_release();
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+bool cryp_sector_busy(void)
+{
+    return sector_dma.running;
+}
@@ -0,0 +1,262 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Cryp sessions.
+ *
+ * Each session owns its key, mode, direction and live IV. Only one session
+ * is loaded in the Cryp engine at a time: switching to another session saves
+ * the IV of the current one (cryp_get_iv()) and loads the new one, skipping
+ * every step whose result is already in the engine:
+ *   - the key (and its AES decryption preparation) is only loaded when the
+ *     key content or the key form (raw or prepared) differs. The injected
+ *     key can't be loaded: its sessions are refused once a key of this task
+ *     replaced it (see cryp_key_injected()),
+ *   - mode, direction and data type are only programmed when they differ,
+ *   - otherwise, only the session IV is reloaded.
+ */
+
+typedef struct {
+    bool                used;
+    bool                has_key;
+    uint8_t             key[32] __attribute__((aligned(4)));
+    enum crypto_key_len key_len;
+    uint8_t             iv[16] __attribute__((aligned(4)));
+    unsigned int        iv_len;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    enum crypto_datatype datatype;
+    bool                native;         /* word-native key and IV */
+} cryp_session_t;
+
+static cryp_session_t sessions[CRYP_MAX_SESSIONS];
+static int session_active = -1;
+
+/* what is currently loaded in the Cryp engine */
+static struct {
+    bool                valid;
+    int                 key_sid;        /* session the key comes from, -1 if none */
+    bool                key_prepared;
+    enum crypto_algo    mode;
+    enum crypto_dir     dir;
+    enum crypto_datatype datatype;
+} session_loaded = { false, -1, false, AES_ECB, ENCRYPT, CRYP_DATATYPE_BYTES };
+
+static cryp_session_stats_t session_stats;
+
+static inline bool cryp_session_valid(int sid)
+{
+    return (sid >= 0) && (sid < CRYP_MAX_SESSIONS) && sessions[sid].used;
+}
+
+static inline bool cryp_mode_has_iv(enum crypto_algo mode)
+{
+    return (mode != AES_ECB) && (mode != DES_ECB) && (mode != TDES_ECB);
+}
+
+/* AES ECB/CBC decryption works on the prepared form of the key */
+static inline bool cryp_session_needs_prepare(const cryp_session_t *s)
+{
+    return (s->dir == DECRYPT) && ((s->mode == AES_ECB) || (s->mode == AES_CBC));
+}
+
+static uint32_t cryp_key_bytes(enum crypto_key_len key_len)
+{
+    return 16 + (8 * key_len);
+}
+
+static bool cryp_session_key_loaded(const cryp_session_t *s)
+{
+    const cryp_session_t *l;
+
+    if (!s->has_key) {
+        /* injected key: can't be loaded from here, only be still in place */
+        return cryp_key_injected();
+    }
+    if (!session_loaded.valid || (session_loaded.key_sid < 0) || cryp_key_injected()) {
+        return false;
+    }
+    l = &sessions[session_loaded.key_sid];
+    if (!l->used || !l->has_key || (l->key_len != s->key_len) || (l->native != s->native)) {
+        return false;
+    }
+    if (session_loaded.key_prepared != cryp_session_needs_prepare(s)) {
+        return false;
+    }
+    return (l == s) || (memcmp(l->key, s->key, cryp_key_bytes(s->key_len)) == 0);
+}
+
+int cryp_session_open(const uint8_t * key, enum crypto_key_len key_len,
+                      const uint8_t * iv, unsigned int iv_len,
+                      enum crypto_algo mode, enum crypto_dir dir)
+{
+    cryp_session_t *s;
+    int sid;
+
+    if ((iv != NULL) && (iv_len != 8) && (iv_len != 16)) {
+        goto err;
+    }
+    for (sid = 0; sid < CRYP_MAX_SESSIONS; sid++) {
+        if (!sessions[sid].used) {
+            break;
+        }
+    }
+    if (sid == CRYP_MAX_SESSIONS) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP session, no more free session!\n");
+#endif
+        goto err;
+    }
+    s = &sessions[sid];
+    memset(s, 0, sizeof(cryp_session_t));
+    if (key) {
+        memcpy(s->key, key, cryp_key_bytes(key_len));
+        s->has_key = true;
+    }
+    s->key_len = key_len;
+    if (iv) {
+        memcpy(s->iv, iv, iv_len);
+        s->iv_len = iv_len;
+    }
+    s->mode = mode;
+    s->dir = dir;
+    s->datatype = CRYP_DATATYPE_BYTES;
+    s->used = true;
+
+    return sid;
+err:
+    return -1;
+}
+
+int cryp_session_close(int sid)
+{
+    if (!cryp_session_valid(sid)) {
+        return -1;
+    }
+    if (session_active == sid) {
+        session_active = -1;
+    }
+    if (session_loaded.key_sid == sid) {
+        /* the key stays in the engine but cannot be matched anymore */
+        session_loaded.key_sid = -1;
+    }
+    memset(&sessions[sid], 0, sizeof(cryp_session_t));
+    return 0;
+}
+
+int cryp_session_set_datatype(int sid, enum crypto_datatype datatype, bool native)
+{
+    cryp_session_t *s;
+
+    if (!cryp_session_valid(sid) || (datatype > CRYP_DATATYPE_BITS)) {
+        return -1;
+    }
+    s = &sessions[sid];
+    if ((session_active == sid) && (s->native != native)) {
+        /* the live IV would be read back in the wrong format */
+        return -1;
+    }
+    if ((session_loaded.key_sid == sid) && (s->native != native)) {
+        session_loaded.key_sid = -1;
+    }
+    s->datatype = datatype;
+    s->native = native;
+    if (session_active == sid) {
+        /* reprogrammed by the next cryp_session_resume() */
+        session_loaded.valid = false;
+    }
+    return 0;
+}
+
+int cryp_session_resume(int sid)
+{
+    cryp_session_t *s;
+    cryp_session_t *cur;
+    const uint8_t *iv;
+
+    if (!cryp_session_valid(sid)) {
+        return -1;
+    }
+    if ((session_active == sid) && session_loaded.valid) {
+        return 0;
+    }
+    s = &sessions[sid];
+    if (!s->has_key && !cryp_key_injected()) {
+        /* a key of this task replaced it, the injector has to set it again */
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP session, the injected key is not in the engine!\n");
+#endif
+        return -1;
+    }
+    iv = (s->iv_len && cryp_mode_has_iv(s->mode)) ? s->iv : NULL;
+
+    /* suspend: keep the live chaining value of the current session */
+    if (session_active >= 0) {
+        cur = &sessions[session_active];
+        if (cur->iv_len && cryp_mode_has_iv(cur->mode)) {
+            if (cur->native) {
+                cryp_get_iv_words((uint32_t *) cur->iv, cur->iv_len);
+            } else {
+                cryp_get_iv(cur->iv, cur->iv_len);
+            }
+        }
+    }
+    session_stats.switches++;
+
+    if (!cryp_session_key_loaded(s)) {
+        cryp_init_datatype(s->key, s->key_len, iv, s->iv_len, s->mode, s->dir,
+                           s->datatype, s->native);
+        session_loaded.key_sid = sid;
+        session_loaded.key_prepared = cryp_session_needs_prepare(s);
+        session_stats.key_loads++;
+        if (session_loaded.key_prepared) {
+            session_stats.key_prepares++;
+        }
+    } else if (!session_loaded.valid ||
+               (session_loaded.mode != s->mode) ||
+               (session_loaded.dir != s->dir) ||
+               (session_loaded.datatype != s->datatype)) {
+        cryp_init_datatype(NULL, s->key_len, iv, s->iv_len, s->mode, s->dir,
+                           s->datatype, s->native);
+        session_stats.reconfs++;
+    } else if (iv) {
+        if (s->native) {
+            cryp_reload_iv_words((const uint32_t *) iv, s->iv_len);
+        } else {
+            cryp_reload_iv(iv, s->iv_len);
+        }
+        session_stats.iv_loads++;
+    }
+
+    session_loaded.mode = s->mode;
+    session_loaded.dir = s->dir;
+    session_loaded.datatype = s->datatype;
+    session_loaded.valid = true;
+    session_active = sid;
+
+    return 0;
+}
+
+int cryp_session_active(void)
+{
+    return session_active;
+}
+
+void cryp_session_invalidate(void)
+{
+    /* the IV of the active session is lost if it has not been saved */
+    session_active = -1;
+    session_loaded.valid = false;
+    session_loaded.key_sid = -1;
+    cryp_key_invalidate();
+}
+
+void cryp_session_get_stats(cryp_session_stats_t * stats)
+{
+    if (stats) {
+        memcpy(stats, &session_stats, sizeof(cryp_session_stats_t));
+    }
+}
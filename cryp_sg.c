@@ -0,0 +1,323 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Scatter-gather (de)cryption.
+ *
+ * The input and output segment lists are walked in parallel. Each step
+ * handles the longest run that is contiguous and word aligned in both lists
+ * (DMA or direct access transfer), or, when a block straddles a segment
+ * boundary (or is not word aligned), gathers this single block into a local
+ * word buffer, (de)crypts it in direct access mode and scatters it back. The
+ * Cryp engine is never reconfigured between two steps, so that chained modes
+ * (CBC, CTR) continue across the segment boundaries. Blocks are the ones of
+ * the configured mode: 8 bytes for (T)DES, 16 bytes for AES.
+ */
+
+#define CRYP_SG_BLOCK_MAX   16
+
+typedef struct {
+    const cryp_iovec_t *iov;
+    uint32_t            cnt;
+    uint32_t            idx;
+    uint32_t            off;
+} cryp_sg_cursor_t;
+
+static void cryp_sg_cursor_init(cryp_sg_cursor_t *cur, const cryp_iovec_t *iov, uint32_t cnt)
+{
+    cur->iov = iov;
+    cur->cnt = cnt;
+    cur->idx = 0;
+    cur->off = 0;
+    /* skip leading empty segments */
+    while ((cur->idx < cur->cnt) && (cur->iov[cur->idx].len == 0)) {
+        cur->idx++;
+    }
+}
+
+static inline uint8_t *cryp_sg_cursor_ptr(const cryp_sg_cursor_t *cur)
+{
+    return cur->iov[cur->idx].base + cur->off;
+}
+
+/* bytes left in the current segment */
+static inline uint32_t cryp_sg_cursor_contig(const cryp_sg_cursor_t *cur)
+{
+    return cur->iov[cur->idx].len - cur->off;
+}
+
+static void cryp_sg_cursor_advance(cryp_sg_cursor_t *cur, uint32_t len)
+{
+    uint32_t chunk;
+
+    while (len > 0) {
+        chunk = cryp_sg_cursor_contig(cur);
+        if (chunk > len) {
+            cur->off += len;
+            return;
+        }
+        len -= chunk;
+        cur->idx++;
+        cur->off = 0;
+        while ((cur->idx < cur->cnt) && (cur->iov[cur->idx].len == 0)) {
+            cur->idx++;
+        }
+    }
+}
+
+/* copy len bytes from the list to buf (gather) or from buf to the list */
+static void cryp_sg_cursor_copy(cryp_sg_cursor_t *cur, uint8_t *buf, uint32_t len, bool gather)
+{
+    uint32_t chunk;
+
+    while (len > 0) {
+        chunk = cryp_sg_cursor_contig(cur);
+        if (chunk > len) {
+            chunk = len;
+        }
+        if (gather) {
+            memcpy(buf, cryp_sg_cursor_ptr(cur), chunk);
+        } else {
+            memcpy(cryp_sg_cursor_ptr(cur), buf, chunk);
+        }
+        buf += chunk;
+        len -= chunk;
+        cryp_sg_cursor_advance(cur, chunk);
+    }
+}
+
+static uint32_t cryp_sg_total(const cryp_iovec_t *iov, uint32_t cnt)
+{
+    uint32_t total = 0;
+    uint32_t i;
+
+    for (i = 0; i < cnt; i++) {
+        total += iov[i].len;
+    }
+    return total;
+}
+
+/*
+ * length of the run that can be handled in one transfer at the current
+ * cursors position, 0 if the next block must be gathered/scattered.
+ */
+static uint32_t cryp_sg_run(const cryp_sg_cursor_t *in, const cryp_sg_cursor_t *out,
+                            uint32_t remaining)
+{
+    uint32_t run;
+
+    if ((((physaddr_t)cryp_sg_cursor_ptr(in) % 4) != 0) ||
+        (((physaddr_t)cryp_sg_cursor_ptr(out) % 4) != 0)) {
+        return 0;
+    }
+    run = remaining;
+    if (cryp_sg_cursor_contig(in) < run) {
+        run = cryp_sg_cursor_contig(in);
+    }
+    if (cryp_sg_cursor_contig(out) < run) {
+        run = cryp_sg_cursor_contig(out);
+    }
+    return run - (run % cryp_block_size());
+}
+
+/* (de)crypt the block straddling a segment boundary, returns its length, 0 on error */
+static uint32_t cryp_sg_stitch(cryp_sg_cursor_t *in, cryp_sg_cursor_t *out)
+{
+    uint32_t block[CRYP_SG_BLOCK_MAX / 4];
+    uint32_t len = cryp_block_size();
+
+    cryp_sg_cursor_copy(in, (uint8_t *) block, len, true);
+    if (cryp_do_no_dma((const uint8_t *) block, (uint8_t *) block, len)) {
+        return 0;
+    }
+    cryp_sg_cursor_copy(out, (uint8_t *) block, len, false);
+    return len;
+}
+
+static int cryp_sg_check(const cryp_iovec_t * in, uint32_t in_cnt,
+                         const cryp_iovec_t * out, uint32_t out_cnt,
+                         uint32_t *total)
+{
+    if ((in == NULL) || (out == NULL)) {
+        return -1;
+    }
+    *total = cryp_sg_total(in, in_cnt);
+    if ((*total != cryp_sg_total(out, out_cnt)) || ((*total % cryp_block_size()) != 0)) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP sg, segment lists length mismatch or not block aligned!\n");
+#endif
+        return -1;
+    }
+    return 0;
+}
+
+int cryp_do_sg_no_dma(const cryp_iovec_t * in, uint32_t in_cnt,
+                      const cryp_iovec_t * out, uint32_t out_cnt)
+{
+    cryp_sg_cursor_t cin, cout;
+    uint32_t remaining;
+    uint32_t run;
+
+    if (cryp_sg_check(in, in_cnt, out, out_cnt, &remaining)) {
+        return -1;
+    }
+    cryp_sg_cursor_init(&cin, in, in_cnt);
+    cryp_sg_cursor_init(&cout, out, out_cnt);
+
+    while (remaining > 0) {
+        run = cryp_sg_run(&cin, &cout, remaining);
+        if (run) {
+            if (cryp_do_no_dma(cryp_sg_cursor_ptr(&cin), cryp_sg_cursor_ptr(&cout), run)) {
+                return -1;
+            }
+            cryp_sg_cursor_advance(&cin, run);
+            cryp_sg_cursor_advance(&cout, run);
+        } else {
+            run = cryp_sg_stitch(&cin, &cout);
+            if (run == 0) {
+                return -1;
+            }
+        }
+        remaining -= run;
+    }
+    return 0;
+}
+
+/*
+ * DMA mode: the runs are DMA transfers chained from the output DMA
+ * completion, straddling blocks being handled in direct access mode in
+ * between.
+ */
+static struct {
+    cryp_sg_cursor_t    in;
+    cryp_sg_cursor_t    out;
+    uint32_t            remaining;
+    uint32_t            inflight;
+    cryp_sg_handler_t   handler;
+    volatile bool       running;
+} sg_dma = { { NULL, 0, 0, 0 }, { NULL, 0, 0, 0 }, 0, 0, NULL, false };
+
+/* 1 if a transfer has been launched, 0 once the lists are done, -1 on error */
+static int cryp_sg_dma_next(void)
+{
+    uint32_t run;
+
+    /* account for the transfer that has just completed */
+    if (sg_dma.inflight) {
+        cryp_sg_cursor_advance(&sg_dma.in, sg_dma.inflight);
+        cryp_sg_cursor_advance(&sg_dma.out, sg_dma.inflight);
+        sg_dma.remaining -= sg_dma.inflight;
+        sg_dma.inflight = 0;
+    }
+
+    while (sg_dma.remaining > 0) {
+        run = cryp_sg_run(&sg_dma.in, &sg_dma.out, sg_dma.remaining);
+        if (run) {
+            sg_dma.inflight = run;
+            if (cryp_dma_launch(cryp_sg_cursor_ptr(&sg_dma.in),
+                                cryp_sg_cursor_ptr(&sg_dma.out), run)) {
+                sg_dma.inflight = 0;
+                sg_dma.running = false;
+                return -1;
+            }
+            return 1;
+        }
+        /* no DMA request must be pending while feeding the FIFOs by hand */
+        cryp_disable_dma();
+        run = cryp_sg_stitch(&sg_dma.in, &sg_dma.out);
+        if (run == 0) {
+            sg_dma.running = false;
+            return -1;
+        }
+        sg_dma.remaining -= run;
+    }
+
+    sg_dma.running = false;
+    return 0;
+}
+
+static void cryp_sg_dma_out_handler(uint8_t irq __attribute__((unused)),
+                                    uint32_t status)
+{
+    int ret;
+
+    if (!sg_dma.running) {
+        return;
+    }
+    if (status & CRYP_DMA_STATUS_ERROR) {
+        sg_dma.inflight = 0;
+        sg_dma.running = false;
+        ret = -1;
+    } else {
+        ret = cryp_sg_dma_next();
+        if (ret > 0) {
+            return;
+        }
+    }
+    cryp_release();
+    if (sg_dma.handler) {
+        sg_dma.handler(ret);
+    }
+}
+
+int cryp_sg_init(int dma_in_desc, int dma_out_desc, cryp_sg_handler_t handler)
+{
+    if (sg_dma.running) {
+        goto err;
+    }
+    sg_dma.handler = handler;
+    if (cryp_init_dma(NULL, cryp_sg_dma_out_handler, dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_do_sg_dma(const cryp_iovec_t * in, uint32_t in_cnt,
+                   const cryp_iovec_t * out, uint32_t out_cnt)
+{
+    uint32_t total;
+    int ret;
+
+    if (sg_dma.running) {
+        return -1;
+    }
+    if (cryp_sg_check(in, in_cnt, out, out_cnt, &total)) {
+        return -1;
+    }
+    if (cryp_claim_try(CRYP_PRIO_NORMAL)) {
+        return -1;
+    }
+    cryp_sg_cursor_init(&sg_dma.in, in, in_cnt);
+    cryp_sg_cursor_init(&sg_dma.out, out, out_cnt);
+    sg_dma.remaining = total;
+    sg_dma.inflight = 0;
+    sg_dma.running = true;
+
+    /* a failure to start is only returned, the handler is not called */
+    ret = cryp_sg_dma_next();
+    if (ret < 0) {
+        cryp_release();
+        return -1;
+    }
+    if (ret == 0) {
+        /* blocks straddling segments only, done without any transfer */
+        cryp_release();
+        if (sg_dma.handler) {
+            sg_dma.handler(0);
+        }
+    }
+    return 0;
+}
+
+bool cryp_sg_busy(void)
+{
+    return sg_dma.running;
+}
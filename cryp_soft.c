@@ -0,0 +1,659 @@
+#include "api/libcryp.h"
+#include "libc/string.h"
+
+#if CONFIG_USR_DRV_CRYP_SOFT
+/*
+ * Software AES and (T)DES.
+ *
+ * Same modes and block handling as the Cryp core, bit for bit, including
+ * the CTR counter which is incremented on its 32 least significant bits
+ * only. Nothing here depends on the device, so that this file may also be
+ * built on a host.
+ *
+ * The implementation is constant time: no branch and no memory access
+ * depends on key or data. The AES S-box is computed by the Boyar-Peralta
+ * circuit, bitsliced over the bytes of a block (the inverse S-box being the
+ * S-box between two inverse affine transforms), and each DES S-box row is
+ * packed in two words, selected with masks then shifted.
+ */
+
+#define CRYP_SOFT_AES_BLOCK     16
+#define CRYP_SOFT_DES_BLOCK     8
+
+static inline bool cryp_soft_is_aes(enum crypto_algo mode)
+{
+    return (mode == AES_ECB) || (mode == AES_CBC) || (mode == AES_CTR);
+}
+
+/*
+ * AES
+ */
+
+/* S-box on 8 bitsliced bytes: q[i] holds the bit i of every byte */
+static void cryp_soft_aes_sbox_bs(uint32_t * q)
+{
+    uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint32_t y20, y21;
+    uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    /* top linear transform */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /* non-linear section */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /* bottom linear transform */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+/* S-box on @n (at most 32) bytes */
+static void cryp_soft_aes_sub(uint8_t * b, uint32_t n)
+{
+    uint32_t q[8];
+    uint32_t i, j;
+
+    for (i = 0; i < 8; i++) {
+        q[i] = 0;
+        for (j = 0; j < n; j++) {
+            q[i] |= (uint32_t)((b[j] >> i) & 1) << j;
+        }
+    }
+    cryp_soft_aes_sbox_bs(q);
+    for (j = 0; j < n; j++) {
+        b[j] = 0;
+        for (i = 0; i < 8; i++) {
+            b[j] |= (uint8_t)(((q[i] >> j) & 1) << i);
+        }
+    }
+}
+
+/* inverse of the S-box affine transform */
+static inline uint8_t cryp_soft_aes_inv_affine(uint8_t x)
+{
+    uint32_t r = ((uint32_t)x << 1) ^ ((uint32_t)x << 3) ^ ((uint32_t)x << 6);
+
+    return (uint8_t)(r ^ (r >> 8) ^ 0x05);
+}
+
+/* S-box^-1(x) = A^-1(S-box(A^-1(x))) */
+static void cryp_soft_aes_inv_sub(uint8_t * b, uint32_t n)
+{
+    uint32_t j;
+
+    for (j = 0; j < n; j++) {
+        b[j] = cryp_soft_aes_inv_affine(b[j]);
+    }
+    cryp_soft_aes_sub(b, n);
+    for (j = 0; j < n; j++) {
+        b[j] = cryp_soft_aes_inv_affine(b[j]);
+    }
+}
+
+static inline uint8_t cryp_soft_xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ (0x1b & -(x >> 7)));
+}
+
+static void cryp_soft_aes_expand(cryp_soft_t * ctx, const uint8_t * key, uint32_t nk)
+{
+    uint8_t *w = ctx->rk.aes;
+    uint8_t t[4];
+    uint8_t rcon = 1;
+    uint32_t i, words;
+
+    ctx->rounds = nk + 6;
+    words = 4 * (ctx->rounds + 1);
+    memcpy(w, key, 4 * nk);
+    for (i = nk; i < words; i++) {
+        memcpy(t, &w[4 * (i - 1)], 4);
+        if ((i % nk) == 0) {
+            /* RotWord, SubWord, Rcon */
+            uint8_t t0 = t[0];
+
+            t[0] = t[1];
+            t[1] = t[2];
+            t[2] = t[3];
+            t[3] = t0;
+            cryp_soft_aes_sub(t, 4);
+            t[0] ^= rcon;
+            rcon = cryp_soft_xtime(rcon);
+        } else if ((nk > 6) && ((i % nk) == 4)) {
+            cryp_soft_aes_sub(t, 4);
+        }
+        w[4 * i] = w[4 * (i - nk)] ^ t[0];
+        w[4 * i + 1] = w[4 * (i - nk) + 1] ^ t[1];
+        w[4 * i + 2] = w[4 * (i - nk) + 2] ^ t[2];
+        w[4 * i + 3] = w[4 * (i - nk) + 3] ^ t[3];
+    }
+}
+
+static inline void cryp_soft_xor(uint8_t * d, const uint8_t * s, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        d[i] ^= s[i];
+    }
+}
+
+/* the state is column major, as the input block */
+static void cryp_soft_aes_shift_rows(uint8_t * s, bool inv)
+{
+    uint8_t t[CRYP_SOFT_AES_BLOCK];
+    uint32_t r, c, shift;
+
+    memcpy(t, s, CRYP_SOFT_AES_BLOCK);
+    for (r = 1; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            shift = inv ? (c + 4 - r) : (c + r);
+            s[4 * c + r] = t[4 * (shift % 4) + r];
+        }
+    }
+}
+
+static void cryp_soft_aes_mix_columns(uint8_t * s, bool inv)
+{
+    uint8_t a0, a1, a2, a3, u, v;
+    uint32_t c;
+
+    for (c = 0; c < 4; c++) {
+        uint8_t *col = &s[4 * c];
+
+        if (inv) {
+            /* (0e 0b 0d 09) = (02 03 01 01) . (05 00 04 00) */
+            u = cryp_soft_xtime(cryp_soft_xtime(col[0] ^ col[2]));
+            v = cryp_soft_xtime(cryp_soft_xtime(col[1] ^ col[3]));
+            col[0] ^= u;
+            col[1] ^= v;
+            col[2] ^= u;
+            col[3] ^= v;
+        }
+        a0 = col[0];
+        a1 = col[1];
+        a2 = col[2];
+        a3 = col[3];
+        u = a0 ^ a1 ^ a2 ^ a3;
+        col[0] = a0 ^ u ^ cryp_soft_xtime(a0 ^ a1);
+        col[1] = a1 ^ u ^ cryp_soft_xtime(a1 ^ a2);
+        col[2] = a2 ^ u ^ cryp_soft_xtime(a2 ^ a3);
+        col[3] = a3 ^ u ^ cryp_soft_xtime(a3 ^ a0);
+    }
+}
+
+static void cryp_soft_aes_encrypt(const cryp_soft_t * ctx, const uint8_t * in, uint8_t * out)
+{
+    uint8_t s[CRYP_SOFT_AES_BLOCK];
+    uint32_t r;
+
+    memcpy(s, in, CRYP_SOFT_AES_BLOCK);
+    cryp_soft_xor(s, ctx->rk.aes, CRYP_SOFT_AES_BLOCK);
+    for (r = 1; r <= ctx->rounds; r++) {
+        cryp_soft_aes_sub(s, CRYP_SOFT_AES_BLOCK);
+        cryp_soft_aes_shift_rows(s, false);
+        if (r != ctx->rounds) {
+            cryp_soft_aes_mix_columns(s, false);
+        }
+        cryp_soft_xor(s, &ctx->rk.aes[CRYP_SOFT_AES_BLOCK * r], CRYP_SOFT_AES_BLOCK);
+    }
+    memcpy(out, s, CRYP_SOFT_AES_BLOCK);
+    memset(s, 0, CRYP_SOFT_AES_BLOCK);
+}
+
+static void cryp_soft_aes_decrypt(const cryp_soft_t * ctx, const uint8_t * in, uint8_t * out)
+{
+    uint8_t s[CRYP_SOFT_AES_BLOCK];
+    uint32_t r;
+
+    memcpy(s, in, CRYP_SOFT_AES_BLOCK);
+    cryp_soft_xor(s, &ctx->rk.aes[CRYP_SOFT_AES_BLOCK * ctx->rounds], CRYP_SOFT_AES_BLOCK);
+    for (r = ctx->rounds; r > 0; r--) {
+        cryp_soft_aes_shift_rows(s, true);
+        cryp_soft_aes_inv_sub(s, CRYP_SOFT_AES_BLOCK);
+        cryp_soft_xor(s, &ctx->rk.aes[CRYP_SOFT_AES_BLOCK * (r - 1)], CRYP_SOFT_AES_BLOCK);
+        if (r != 1) {
+            cryp_soft_aes_mix_columns(s, true);
+        }
+    }
+    memcpy(out, s, CRYP_SOFT_AES_BLOCK);
+    memset(s, 0, CRYP_SOFT_AES_BLOCK);
+}
+
+/*
+ * DES
+ */
+
+/* permutation tables, 1-based bit positions from the most significant bit */
+static const uint8_t cryp_soft_des_ip[64] = {
+    58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
+    62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+    57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3,
+    61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7
+};
+
+static const uint8_t cryp_soft_des_fp[64] = {
+    40, 8, 48, 16, 56, 24, 64, 32, 39, 7, 47, 15, 55, 23, 63, 31,
+    38, 6, 46, 14, 54, 22, 62, 30, 37, 5, 45, 13, 53, 21, 61, 29,
+    36, 4, 44, 12, 52, 20, 60, 28, 35, 3, 43, 11, 51, 19, 59, 27,
+    34, 2, 42, 10, 50, 18, 58, 26, 33, 1, 41, 9, 49, 17, 57, 25
+};
+
+static const uint8_t cryp_soft_des_e[48] = {
+    32, 1, 2, 3, 4, 5, 4, 5, 6, 7, 8, 9,
+    8, 9, 10, 11, 12, 13, 12, 13, 14, 15, 16, 17,
+    16, 17, 18, 19, 20, 21, 20, 21, 22, 23, 24, 25,
+    24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32, 1
+};
+
+static const uint8_t cryp_soft_des_p[32] = {
+    16, 7, 20, 21, 29, 12, 28, 17, 1, 15, 23, 26, 5, 18, 31, 10,
+    2, 8, 24, 14, 32, 27, 3, 9, 19, 13, 30, 6, 22, 11, 4, 25
+};
+
+static const uint8_t cryp_soft_des_pc1[56] = {
+    57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18,
+    10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+    63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22,
+    14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4
+};
+
+static const uint8_t cryp_soft_des_pc2[48] = {
+    14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10,
+    23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+    41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+    44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32
+};
+
+static const uint8_t cryp_soft_des_shifts[16] = {
+    1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1
+};
+
+/* S-boxes: the nibbles of the columns 0-7 and 8-15 of each row */
+static const uint32_t cryp_soft_des_sbox[8][4][2] = {
+    {   /* S1 */
+        { 0x8bf21d4e, 0x7095c6a3 }, { 0x1d2e47f0, 0x8359bc6a },
+        { 0xb26d8e14, 0x05a379cf }, { 0x719428cf, 0xd60ae3b5 }
+    },
+    {   /* S2 */
+        { 0x43b6e81f, 0xa50cd279 }, { 0xe82f74d3, 0x5b96a10c },
+        { 0x1d4ab7e0, 0xf2396c85 }, { 0x24f31a8d, 0x9e50c76b }
+    },
+    {   /* S3 */
+        { 0x5f36e90a, 0x824b7cd1 }, { 0xa643907d, 0x1fbce582 },
+        { 0x03f8946d, 0x7ea5c21b }, { 0x78960da1, 0xc25b3ef4 }
+    },
+    {   /* S4 */
+        { 0xa9603ed7, 0xf4cb5821 }, { 0x30f65b8d, 0x9ea1c274 },
+        { 0xd7bc096a, 0x4825e31f }, { 0x8d1a60f3, 0xe27cb549 }
+    },
+    {   /* S5 */
+        { 0x6ba714c2, 0x9e0df358 }, { 0x1d74c2be, 0x6893af05 },
+        { 0x87dab124, 0xe0365c9f }, { 0xd2e17c8b, 0x354a90f6 }
+    },
+    {   /* S6 */
+        { 0x8629fa1c, 0xb57e43d0 }, { 0x59c724fa, 0x83b0ed16 },
+        { 0x3c825fe9, 0x6bd1a407 }, { 0xaf59c234, 0xd80671eb }
+    },
+    {   /* S7 */
+        { 0xd80fe2b4, 0x16a579c3 }, { 0xa1947b0d, 0x68f2c53e },
+        { 0xe73cdb41, 0x295086fa }, { 0x7a418db6, 0xc32ef059 }
+    },
+    {   /* S8 */
+        { 0x1bf6482d, 0x7c05e39a }, { 0x473a8df1, 0x29e0b65c },
+        { 0x2ec914b7, 0x853fda60 }, { 0xd8a47e12, 0xb65309cf }
+    }
+
+};
+
+static uint64_t cryp_soft_des_permute(uint64_t in, uint32_t in_bits,
+                                      const uint8_t * table, uint32_t n)
+{
+    uint64_t out = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        out = (out << 1) | ((in >> (in_bits - table[i])) & 1);
+    }
+    return out;
+}
+
+/* constant time S-box lookup of the 6 bits @b */
+static uint32_t cryp_soft_des_sbox_get(uint32_t s, uint32_t b)
+{
+    uint32_t row = ((b >> 4) & 2) | (b & 1);
+    uint32_t col = (b >> 1) & 0xf;
+    uint32_t lo = 0, hi = 0, m, r;
+
+    for (r = 0; r < 4; r++) {
+        m = -(((r ^ row) - 1) >> 31);
+        lo |= cryp_soft_des_sbox[s][r][0] & m;
+        hi |= cryp_soft_des_sbox[s][r][1] & m;
+    }
+    m = -(col >> 3);
+    return (((lo & ~m) | (hi & m)) >> (4 * (col & 7))) & 0xf;
+}
+
+static uint32_t cryp_soft_des_f(uint32_t r, uint64_t k)
+{
+    uint64_t x = cryp_soft_des_permute(r, 32, cryp_soft_des_e, 48) ^ k;
+    uint32_t out = 0;
+    uint32_t s;
+
+    for (s = 0; s < 8; s++) {
+        out = (out << 4) | cryp_soft_des_sbox_get(s, (uint32_t)(x >> (42 - 6 * s)) & 0x3f);
+    }
+    return (uint32_t) cryp_soft_des_permute(out, 32, cryp_soft_des_p, 32);
+}
+
+static void cryp_soft_des_expand(uint64_t * sk, const uint8_t * key)
+{
+    uint64_t k = 0;
+    uint32_t c, d, i;
+
+    for (i = 0; i < 8; i++) {
+        k = (k << 8) | key[i];
+    }
+    k = cryp_soft_des_permute(k, 64, cryp_soft_des_pc1, 56);
+    c = (uint32_t)(k >> 28) & 0xfffffff;
+    d = (uint32_t) k & 0xfffffff;
+    for (i = 0; i < 16; i++) {
+        c = ((c << cryp_soft_des_shifts[i]) | (c >> (28 - cryp_soft_des_shifts[i]))) & 0xfffffff;
+        d = ((d << cryp_soft_des_shifts[i]) | (d >> (28 - cryp_soft_des_shifts[i]))) & 0xfffffff;
+        sk[i] = cryp_soft_des_permute(((uint64_t) c << 28) | d, 56, cryp_soft_des_pc2, 48);
+    }
+}
+
+static uint64_t cryp_soft_des_block(const uint64_t * sk, uint64_t in, bool dec)
+{
+    uint64_t x = cryp_soft_des_permute(in, 64, cryp_soft_des_ip, 64);
+    uint32_t l = (uint32_t)(x >> 32);
+    uint32_t r = (uint32_t) x;
+    uint32_t t, i;
+
+    for (i = 0; i < 16; i++) {
+        t = r;
+        r = l ^ cryp_soft_des_f(r, sk[dec ? (15 - i) : i]);
+        l = t;
+    }
+    return cryp_soft_des_permute(((uint64_t) r << 32) | l, 64, cryp_soft_des_fp, 64);
+}
+
+/* DES, or TDES as E(K3, D(K2, E(K1, x))) */
+static void cryp_soft_des_crypt(const cryp_soft_t * ctx, const uint8_t * in, uint8_t * out, bool dec)
+{
+    uint64_t x = 0;
+    uint32_t i;
+
+    for (i = 0; i < CRYP_SOFT_DES_BLOCK; i++) {
+        x = (x << 8) | in[i];
+    }
+    if ((ctx->mode == DES_ECB) || (ctx->mode == DES_CBC)) {
+        x = cryp_soft_des_block(ctx->rk.des[0], x, dec);
+    } else if (!dec) {
+        x = cryp_soft_des_block(ctx->rk.des[0], x, false);
+        x = cryp_soft_des_block(ctx->rk.des[1], x, true);
+        x = cryp_soft_des_block(ctx->rk.des[2], x, false);
+    } else {
+        x = cryp_soft_des_block(ctx->rk.des[2], x, true);
+        x = cryp_soft_des_block(ctx->rk.des[1], x, false);
+        x = cryp_soft_des_block(ctx->rk.des[0], x, true);
+    }
+    for (i = CRYP_SOFT_DES_BLOCK; i > 0; i--) {
+        out[i - 1] = (uint8_t) x;
+        x >>= 8;
+    }
+}
+
+/*
+ * Modes
+ */
+
+int cryp_soft_init(cryp_soft_t * ctx, const uint8_t * key, enum crypto_key_len key_len,
+                   const uint8_t * iv, unsigned int iv_len,
+                   enum crypto_algo mode, enum crypto_dir dir)
+{
+    uint32_t i;
+
+    if ((ctx == NULL) || (key == NULL)) {
+        goto err;
+    }
+    memset(ctx, 0, sizeof(cryp_soft_t));
+    ctx->mode = mode;
+    ctx->dir = dir;
+    if (cryp_soft_is_aes(mode)) {
+        ctx->block = CRYP_SOFT_AES_BLOCK;
+        cryp_soft_aes_expand(ctx, key, 4 + 2 * key_len);
+    } else if ((mode == DES_ECB) || (mode == DES_CBC)) {
+        ctx->block = CRYP_SOFT_DES_BLOCK;
+        cryp_soft_des_expand(ctx->rk.des[0], key);
+    } else if ((mode == TDES_ECB) || (mode == TDES_CBC)) {
+        /* 24 bytes key, K1 || K2 || K3 */
+        ctx->block = CRYP_SOFT_DES_BLOCK;
+        for (i = 0; i < 3; i++) {
+            cryp_soft_des_expand(ctx->rk.des[i], &key[8 * i]);
+        }
+    } else {
+        goto err;
+    }
+    if ((iv != NULL) && (iv_len == ctx->block)) {
+        memcpy(ctx->iv, iv, iv_len);
+    }
+    return 0;
+err:
+    return -1;
+}
+
+static void cryp_soft_block(const cryp_soft_t * ctx, const uint8_t * in, uint8_t * out, bool dec)
+{
+    if (ctx->block == CRYP_SOFT_AES_BLOCK) {
+        if (dec) {
+            cryp_soft_aes_decrypt(ctx, in, out);
+        } else {
+            cryp_soft_aes_encrypt(ctx, in, out);
+        }
+    } else {
+        cryp_soft_des_crypt(ctx, in, out, dec);
+    }
+}
+
+int cryp_soft_do(cryp_soft_t * ctx, const uint8_t * data_in, uint8_t * data_out,
+                 uint32_t data_len)
+{
+    uint8_t blk[CRYP_SOFT_AES_BLOCK];
+    uint32_t bs, i;
+
+    if ((ctx == NULL) || (ctx->block == 0) || (data_len % ctx->block) ||
+        ((data_len > 0) && ((data_in == NULL) || (data_out == NULL)))) {
+        goto err;
+    }
+    bs = ctx->block;
+    for (; data_len > 0; data_len -= bs, data_in += bs, data_out += bs) {
+        if (ctx->mode == AES_CTR) {
+            /* as the Cryp core, only the 32 least significant bits count */
+            cryp_soft_aes_encrypt(ctx, ctx->iv, blk);
+            for (i = 0; i < bs; i++) {
+                data_out[i] = data_in[i] ^ blk[i];
+            }
+            for (i = bs; i > bs - 4; i--) {
+                if (++ctx->iv[i - 1] != 0) {
+                    break;
+                }
+            }
+        } else if ((ctx->mode == AES_ECB) || (ctx->mode == DES_ECB) || (ctx->mode == TDES_ECB)) {
+            cryp_soft_block(ctx, data_in, data_out, ctx->dir == DECRYPT);
+        } else if (ctx->dir == ENCRYPT) {
+            memcpy(blk, data_in, bs);
+            cryp_soft_xor(blk, ctx->iv, bs);
+            cryp_soft_block(ctx, blk, data_out, false);
+            memcpy(ctx->iv, data_out, bs);
+        } else {
+            /* the input may be the output buffer */
+            memcpy(blk, data_in, bs);
+            cryp_soft_block(ctx, blk, data_out, true);
+            cryp_soft_xor(data_out, ctx->iv, bs);
+            memcpy(ctx->iv, blk, bs);
+        }
+    }
+    memset(blk, 0, sizeof(blk));
+    return 0;
+err:
+    return -1;
+}
+
+void cryp_soft_get_iv(const cryp_soft_t * ctx, uint8_t * iv, unsigned int iv_len)
+{
+    if ((ctx == NULL) || (iv == NULL) || (iv_len != ctx->block)) {
+        return;
+    }
+    memcpy(iv, ctx->iv, iv_len);
+}
+
+void cryp_soft_wipe(cryp_soft_t * ctx)
+{
+    if (ctx != NULL) {
+        memset(ctx, 0, sizeof(cryp_soft_t));
+    }
+}
+#endif
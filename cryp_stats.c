@@ -0,0 +1,101 @@
+#include "api/libcryp.h"
+#include "cryp_regs.h"
+#include "cryp_stats.h"
+#include "libc/string.h"
+
+#if CONFIG_USR_DRV_CRYP_STATS
+/*
+ * Driver statistics, timestamped with cryp_cycles().
+ */
+
+static cryp_stats_t cryp_stats;
+static uint32_t     cryp_stats_start[CRYP_STATS_PHASES];
+static uint32_t     cryp_stats_hold_start[CRYP_PRIO_CLASSES];
+
+void cryp_stats_begin(enum cryp_stats_phase phase)
+{
+    cryp_stats_start[phase] = cryp_cycles();
+}
+
+/* the 32 bits counter difference stays right across a single wrap */
+static void cryp_stats_account(cryp_stats_phase_t * p, uint32_t start)
+{
+    uint32_t cycles = cryp_cycles() - start;
+
+    p->count++;
+    p->cycles += cycles;
+    if (cycles > p->max) {
+        p->max = cycles;
+    }
+}
+
+void cryp_stats_end(enum cryp_stats_phase phase)
+{
+    cryp_stats_account(&cryp_stats.phase[phase], cryp_stats_start[phase]);
+}
+
+/* bucket b > 0 holds [2^(b-1), 2^b - 1] polls, the last one being open */
+void cryp_stats_spins(enum cryp_stats_wait wait, uint32_t spins)
+{
+    uint32_t b = 0;
+    uint32_t n = spins;
+
+    while ((n > 0) && (b < (CRYP_STATS_BUCKETS - 1))) {
+        n >>= 1;
+        b++;
+    }
+    cryp_stats.spins[wait][b]++;
+    if (spins > cryp_stats.spins_max[wait]) {
+        cryp_stats.spins_max[wait] = spins;
+    }
+}
+
+void cryp_stats_bytes(uint32_t cr, uint32_t bytes)
+{
+    uint32_t mode = ((cr & CRYP_CR_ALGOMODE_Msk) >> CRYP_CR_ALGOMODE_Pos) |
+                    (((cr & CRYP_CR_ALGOMODE3_Msk) >> CRYP_CR_ALGOMODE3_Pos) << 3);
+    uint32_t dir = (cr & CRYP_CR_ALGODIR_Msk) >> CRYP_CR_ALGODIR_Pos;
+
+    if (mode <= AES_CCM) {
+        cryp_stats.bytes[mode][dir] += bytes;
+    }
+}
+
+void cryp_stats_hold_begin(enum cryp_prio prio)
+{
+    cryp_stats_hold_start[prio] = cryp_cycles();
+}
+
+void cryp_stats_hold_end(enum cryp_prio prio)
+{
+    cryp_stats_account(&cryp_stats.hold[prio], cryp_stats_hold_start[prio]);
+}
+
+void cryp_stats_contended(enum cryp_prio prio)
+{
+    cryp_stats.contended[prio]++;
+}
+
+void cryp_stats_map_op(void)
+{
+    cryp_stats.map_ops++;
+}
+
+void cryp_stats_map_syscall(void)
+{
+    cryp_stats.map_syscalls++;
+}
+
+void cryp_stats_get(cryp_stats_t * stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    memcpy(stats, &cryp_stats, sizeof(cryp_stats_t));
+}
+
+void cryp_stats_reset(void)
+{
+    memset(&cryp_stats, 0, sizeof(cryp_stats_t));
+}
+#endif
@@ -0,0 +1,80 @@
+#ifndef CRYP_STATS_H
+#define CRYP_STATS_H
+
+#include "api/libcryp.h"
+#include "libc/regutils.h"
+#include "libc/syscall.h"
+
+#if CONFIG_USR_DRV_CRYP_STATS || CONFIG_USR_DRV_CRYP_TRACE
+#if !defined(__arm__)
+# include <time.h>
+#endif
+
+#define r_CORTEX_M_DWT_CYCCNT       REG_ADDR(0xe0001004)
+
+/*
+ * Timestamp of the statistics and of the register trace. Read from the DWT
+ * cycle counter when the task is allowed to (CONFIG_USR_DRV_CRYP_STATS_DWT),
+ * otherwise from sys_get_systick(), the syscall cost being then part of the
+ * measures. Host builds (register model) use the host monotonic clock, in
+ * nanoseconds.
+ */
+static inline uint32_t cryp_cycles(void)
+{
+#if !defined(__arm__)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+#elif CONFIG_USR_DRV_CRYP_STATS_DWT
+    return read_reg_value(r_CORTEX_M_DWT_CYCCNT);
+#else
+    uint64_t ticks = 0;
+
+    sys_get_systick(&ticks, PREC_CYCLE);
+    return (uint32_t) ticks;
+#endif
+}
+#endif
+
+/*
+ * Instrumentation hooks of the driver hot paths. Without
+ * CONFIG_USR_DRV_CRYP_STATS they expand to nothing: their arguments are not
+ * evaluated, and the spin counters left unused are optimized out.
+ */
+#if CONFIG_USR_DRV_CRYP_STATS
+
+void cryp_stats_begin(enum cryp_stats_phase phase);
+
+void cryp_stats_end(enum cryp_stats_phase phase);
+
+void cryp_stats_spins(enum cryp_stats_wait wait, uint32_t spins);
+
+/* @cr is the control register value the bytes have been processed with */
+void cryp_stats_bytes(uint32_t cr, uint32_t bytes);
+
+void cryp_stats_hold_begin(enum cryp_prio prio);
+
+void cryp_stats_hold_end(enum cryp_prio prio);
+
+void cryp_stats_contended(enum cryp_prio prio);
+
+void cryp_stats_map_op(void);
+
+void cryp_stats_map_syscall(void);
+
+#else
+
+# define cryp_stats_begin(phase)        do { } while (0)
+# define cryp_stats_end(phase)          do { } while (0)
+# define cryp_stats_spins(wait, spins)  ((void)(spins))
+# define cryp_stats_bytes(cr, bytes)    do { } while (0)
+# define cryp_stats_hold_begin(prio)    do { } while (0)
+# define cryp_stats_hold_end(prio)      do { } while (0)
+# define cryp_stats_contended(prio)     do { } while (0)
+# define cryp_stats_map_op()            do { } while (0)
+# define cryp_stats_map_syscall()       do { } while (0)
+
+#endif
+
+#endif                          /* CRYP_STATS_H */
@@ -0,0 +1,138 @@
+#include "api/libcryp.h"
+#include "libc/syscall.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+
+/*
+ * Ping-pong DMA streaming stage.
+ *
+ * Buffers are pushed in a small ring. The transfer of the next buffer is
+ * started from the output DMA completion of the current one, so that the
+ * producer can fill buffer N+1 while buffer N is being (de)crypted.
+ *
+ * The ring head is only moved by the DMA handler and the ring tail only by
+ * the task main thread. As the ISR thread cannot be preempted by the main
+ * thread, no lock is required.
+ *
+ * The stream owns the engine as CRYP_PRIO_NORMAL from its start to the
+ * completion of the last pending buffer.
+ */
+
+typedef struct {
+    const uint8_t *in;
+    uint8_t       *out;
+    uint32_t       size;
+} cryp_stream_slot_t;
+
+static cryp_stream_slot_t stream_ring[CRYP_STREAM_DEPTH];
+static volatile uint32_t stream_head = 0;
+static volatile uint32_t stream_tail = 0;
+static volatile bool stream_running = false;
+static cryp_stream_handler_t stream_handler = NULL;
+
+static int cryp_stream_launch(void)
+{
+    cryp_stream_slot_t *slot = &stream_ring[stream_head % CRYP_STREAM_DEPTH];
+
+    return cryp_dma_launch(slot->in, slot->out, slot->size);
+}
+
+static void cryp_stream_dma_out_handler(uint8_t irq __attribute__((unused)),
+                                        uint32_t status)
+{
+    cryp_stream_slot_t *slot;
+    int ret = 0;
+
+    if (!stream_running) {
+        return;
+    }
+    slot = &stream_ring[stream_head % CRYP_STREAM_DEPTH];
+    stream_head++;
+
+    /* start the next buffer first, the CRYP must not wait for the consumer */
+    if (stream_tail != stream_head) {
+        ret = cryp_stream_launch();
+    }
+    if ((stream_tail == stream_head) || ret) {
+        stream_running = false;
+        cryp_release();
+    }
+
+    if (stream_handler) {
+        stream_handler((status & CRYP_DMA_STATUS_ERROR) ? -1 : 0,
+                       slot->in, slot->out, slot->size);
+    }
+    if (ret) {
+#if CONFIG_USR_DRV_CRYP_DEBUG
+        printf("Error: CRYP stream, unable to start next buffer!\n");
+#endif
+        /* the pending buffers are dropped, the producer is told which ones */
+        while (stream_tail != stream_head) {
+            slot = &stream_ring[stream_head % CRYP_STREAM_DEPTH];
+            stream_head++;
+            if (stream_handler) {
+                stream_handler(-1, slot->in, slot->out, slot->size);
+            }
+        }
+    }
+}
+
+int cryp_stream_init(int dma_in_desc, int dma_out_desc,
+                     cryp_stream_handler_t handler)
+{
+    if (stream_running) {
+        goto err;
+    }
+    stream_head = 0;
+    stream_tail = 0;
+    stream_handler = handler;
+
+    if (cryp_init_dma(NULL, cryp_stream_dma_out_handler, dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    if (cryp_dma_prepare(dma_in_desc, dma_out_desc)) {
+        goto err;
+    }
+    return 0;
+err:
+    return -1;
+}
+
+int cryp_stream_push(const uint8_t * bufin, uint8_t * bufout, uint32_t size)
+{
+    cryp_stream_slot_t *slot;
+
+    if ((stream_tail - stream_head) >= CRYP_STREAM_DEPTH) {
+        /* ring is full */
+        goto err;
+    }
+    slot = &stream_ring[stream_tail % CRYP_STREAM_DEPTH];
+    slot->in = bufin;
+    slot->out = bufout;
+    slot->size = size;
+    stream_tail++;
+
+    /* when idle, no DMA handler can be executed until we start the stream */
+    if (!stream_running) {
+        if (cryp_claim_try(CRYP_PRIO_NORMAL)) {
+            stream_tail--;
+            goto err;
+        }
+        stream_running = true;
+        if (cryp_stream_launch()) {
+            stream_running = false;
+            stream_tail--;
+            cryp_release();
+            goto err;
+        }
+    }
+    return 0;
+err:
+    return -1;
+}
+
+uint32_t cryp_stream_pending(void)
+{
+    return stream_tail - stream_head;
+}
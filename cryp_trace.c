@@ -0,0 +1,142 @@
+#include "api/libcryp.h"
+#include "cryp_regs.h"
+#include "cryp_stats.h"
+#include "libc/regutils.h"
+#include "libc/stdio.h"
+#include "libc/string.h"
+
+#if CONFIG_USR_DRV_CRYP_TRACE
+/* the real accessors, before cryp_trace.h redirects them */
+static inline uint32_t cryp_trace_raw_read(volatile uint32_t * reg)
+{
+    return read_reg_value(reg);
+}
+
+static inline void cryp_trace_raw_write(volatile uint32_t * reg, uint32_t value)
+{
+    write_reg_value(reg, value);
+}
+#endif
+
+#include "cryp_trace.h"
+
+#if CONFIG_USR_DRV_CRYP_TRACE
+/*
+ * Register access trace.
+ *
+ * The ring is indexed by free running counters: head counts the recorded
+ * entries, tail the dumped (or overwritten) ones. Entries are recorded from
+ * both the task and the ISR (DMA handlers, CRYP IRQ) contexts; a slot is
+ * claimed before being filled, so that an ISR preempting the recording of
+ * an entry records its own one in the next slot.
+ */
+#if (CONFIG_USR_DRV_CRYP_TRACE_SIZE & (CONFIG_USR_DRV_CRYP_TRACE_SIZE - 1)) != 0
+# error "CONFIG_USR_DRV_CRYP_TRACE_SIZE must be a power of two"
+#endif
+#define CRYP_TRACE_MASK     (CONFIG_USR_DRV_CRYP_TRACE_SIZE - 1)
+
+static cryp_trace_entry_t cryp_trace_ring[CONFIG_USR_DRV_CRYP_TRACE_SIZE];
+static volatile uint32_t  cryp_trace_head = 0;
+static volatile uint32_t  cryp_trace_tail = 0;
+static volatile uint32_t  cryp_trace_lost = 0;
+static volatile bool      cryp_trace_on = true;
+
+/* data, IV and GCM/CCM context values are only kept on demand, keys never */
+static inline uint32_t cryp_trace_filter(uint32_t off, uint32_t value)
+{
+    if ((off >= 0x20) && (off < 0x40)) {
+        return 0;
+    }
+#if !CONFIG_USR_DRV_CRYP_TRACE_DATA
+    if ((off == 0x08) || (off == 0x0c) || (off >= 0x40)) {
+        return 0;
+    }
+#endif
+    return value;
+}
+
+static void cryp_trace_record(uint8_t op, uint8_t reg, uint32_t value)
+{
+    cryp_trace_entry_t *e;
+
+    if (!cryp_trace_on) {
+        return;
+    }
+    e = &cryp_trace_ring[cryp_trace_head++ & CRYP_TRACE_MASK];
+    e->stamp = cryp_cycles();
+    e->op = op;
+    e->reg = reg;
+    e->reserved = 0;
+    e->value = value;
+}
+
+uint32_t cryp_trace_read(volatile uint32_t * reg)
+{
+    uint32_t off = (uint32_t)((physaddr_t) reg - CRYP_BASE);
+    uint32_t value = cryp_trace_raw_read(reg);
+
+    cryp_trace_record(CRYP_TRACE_READ, (uint8_t) off, cryp_trace_filter(off, value));
+    return value;
+}
+
+void cryp_trace_write(volatile uint32_t * reg, uint32_t value)
+{
+    uint32_t off = (uint32_t)((physaddr_t) reg - CRYP_BASE);
+
+    cryp_trace_raw_write(reg, value);
+    cryp_trace_record(CRYP_TRACE_WRITE, (uint8_t) off, cryp_trace_filter(off, value));
+}
+
+void cryp_trace_event(enum cryp_trace_op op, uint32_t value)
+{
+    cryp_trace_record((uint8_t) op, 0, value);
+}
+
+void cryp_trace_enable(bool enable)
+{
+    cryp_trace_on = enable;
+}
+
+uint32_t cryp_trace_dump(cryp_trace_entry_t * entries, uint32_t max, uint32_t * lost)
+{
+    uint32_t head = cryp_trace_head;
+    uint32_t n;
+    uint32_t i;
+
+    /* the oldest entries have been overwritten */
+    if ((head - cryp_trace_tail) > CONFIG_USR_DRV_CRYP_TRACE_SIZE) {
+        cryp_trace_lost += (head - cryp_trace_tail) - CONFIG_USR_DRV_CRYP_TRACE_SIZE;
+        cryp_trace_tail = head - CONFIG_USR_DRV_CRYP_TRACE_SIZE;
+    }
+    n = head - cryp_trace_tail;
+    if ((entries == NULL) || (n > max)) {
+        n = (entries == NULL) ? 0 : max;
+    }
+    for (i = 0; i < n; i++) {
+        entries[i] = cryp_trace_ring[(cryp_trace_tail + i) & CRYP_TRACE_MASK];
+    }
+    cryp_trace_tail += n;
+    if (lost) {
+        *lost = cryp_trace_lost;
+        cryp_trace_lost = 0;
+    }
+    return n;
+}
+
+void cryp_trace_print(void)
+{
+    cryp_trace_entry_t batch[16];
+    uint32_t lost = 0;
+    uint32_t n;
+    uint32_t i;
+
+    while ((n = cryp_trace_dump(batch, 16, &lost)) > 0) {
+        if (lost) {
+            printf("cryp trace: %x entries lost\n", lost);
+        }
+        for (i = 0; i < n; i++) {
+            printf("%x %x %x %x\n", batch[i].stamp, batch[i].op, batch[i].reg, batch[i].value);
+        }
+    }
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef CRYP_TRACE_H
+#define CRYP_TRACE_H
+
+#include "api/libcryp.h"
+#include "libc/regutils.h"
+
+/*
+ * Register access trace. With CONFIG_USR_DRV_CRYP_TRACE, the register
+ * accessors of libc/regutils.h used by the driver are redirected to the
+ * recording ones below: this header must be included after
+ * libc/regutils.h, and only by the files accessing the CRYP registers.
+ */
+#if CONFIG_USR_DRV_CRYP_TRACE
+
+uint32_t cryp_trace_read(volatile uint32_t * reg);
+
+void cryp_trace_write(volatile uint32_t * reg, uint32_t value);
+
+void cryp_trace_event(enum cryp_trace_op op, uint32_t value);
+
+# define read_reg_value(reg)            cryp_trace_read(reg)
+# define write_reg_value(reg, value)    cryp_trace_write((reg), (value))
+# define get_reg_value(reg, mask, pos)  ((cryp_trace_read(reg) & (mask)) >> (pos))
+# define set_reg_bits(reg, value)       cryp_trace_write((reg), cryp_trace_read(reg) | (value))
+# define clear_reg_bits(reg, value)     cryp_trace_write((reg), cryp_trace_read(reg) & ~(value))
+
+#else
+
+# define cryp_trace_event(op, value)    do { } while (0)
+
+#endif
+
+#endif                          /* CRYP_TRACE_H */
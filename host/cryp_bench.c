@@ -0,0 +1,288 @@
+/*
+ * libcryp throughput and latency benchmark, on the host CRYP model.
+ *
+ * Sweeps the (T)DES/AES ECB/CBC/CTR modes, the key lengths, both directions
+ * and power of two buffer sizes, through the direct access path
+ * (cryp_do_no_dma()) and the DMA path (cryp_do_dma()). Each output is
+ * checked against libcrypto, so that the benchmark also gates regressions:
+ * the exit status is not 0 on a mismatch.
+ *
+ * Times are model cycles (see host/cryp_model.h), throughputs being given
+ * for CRYP_MODEL_HZ. The CRYP register accesses (reads/writes) made by the
+ * driver are counted for each transfer, the setup ones being part of the
+ * init figures.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "api/libcryp.h"
+#include "cryp_model.h"
+
+static const struct {
+    const char          *name;
+    enum crypto_algo     mode;
+    uint32_t             block;
+    bool                 has_iv;
+} bench_modes[] = {
+    { "tdes-ecb", TDES_ECB, 8,  false },
+    { "tdes-cbc", TDES_CBC, 8,  true  },
+    { "des-ecb",  DES_ECB,  8,  false },
+    { "des-cbc",  DES_CBC,  8,  true  },
+    { "aes-ecb",  AES_ECB,  16, false },
+    { "aes-cbc",  AES_CBC,  16, true  },
+    { "aes-ctr",  AES_CTR,  16, true  },
+};
+
+#define BENCH_MODES     (sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+static int dma_in_desc;
+static int dma_out_desc;
+static volatile bool dma_done;
+
+static uint8_t *bench_in;
+static uint8_t *bench_out;
+static uint8_t *bench_ref;
+
+static void bench_dma_in(uint8_t irq, uint32_t status)
+{
+    (void) irq;
+    (void) status;
+}
+
+static void bench_dma_out(uint8_t irq, uint32_t status)
+{
+    (void) irq;
+    (void) status;
+    dma_done = true;
+}
+
+static const EVP_CIPHER *bench_cipher(enum crypto_algo mode, enum crypto_key_len key_len)
+{
+    switch (mode) {
+    case TDES_ECB:
+    case DES_ECB:
+        return EVP_des_ede3_ecb();
+    case TDES_CBC:
+    case DES_CBC:
+        return EVP_des_ede3_cbc();
+    case AES_ECB:
+        return (key_len == KEY_128) ? EVP_aes_128_ecb() :
+               (key_len == KEY_192) ? EVP_aes_192_ecb() : EVP_aes_256_ecb();
+    case AES_CBC:
+        return (key_len == KEY_128) ? EVP_aes_128_cbc() :
+               (key_len == KEY_192) ? EVP_aes_192_cbc() : EVP_aes_256_cbc();
+    default:
+        return (key_len == KEY_128) ? EVP_aes_128_ctr() :
+               (key_len == KEY_192) ? EVP_aes_192_ctr() : EVP_aes_256_ctr();
+    }
+}
+
+/* libcrypto result; single DES being EDE with the same key three times */
+static void bench_reference(enum crypto_algo mode, enum crypto_key_len key_len,
+                            enum crypto_dir dir, const uint8_t * key, const uint8_t * iv,
+                            uint32_t size)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    uint8_t k[32];
+    int len;
+
+    memcpy(k, key, 32);
+    if ((mode == DES_ECB) || (mode == DES_CBC)) {
+        memcpy(k + 8, key, 8);
+        memcpy(k + 16, key, 8);
+    }
+    EVP_CipherInit_ex(ctx, bench_cipher(mode, key_len), NULL, k, iv, (dir == ENCRYPT) ? 1 : 0);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    EVP_CipherUpdate(ctx, bench_ref, &len, bench_in, (int) size);
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+typedef struct {
+    uint64_t      cycles;
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long sr_reads;
+    unsigned long syscalls;
+} bench_cost_t;
+
+static void bench_mark(bench_cost_t * c)
+{
+    c->cycles = cryp_model_stats.cycles;
+    c->reads = cryp_model_stats.reads;
+    c->writes = cryp_model_stats.writes;
+    c->sr_reads = cryp_model_stats.sr_reads;
+    c->syscalls = cryp_model_stats.syscalls;
+}
+
+static void bench_since(bench_cost_t * c)
+{
+    c->cycles = cryp_model_stats.cycles - c->cycles;
+    c->reads = cryp_model_stats.reads - c->reads;
+    c->writes = cryp_model_stats.writes - c->writes;
+    c->sr_reads = cryp_model_stats.sr_reads - c->sr_reads;
+    c->syscalls = cryp_model_stats.syscalls - c->syscalls;
+}
+
+static double bench_mbps(uint32_t size, uint64_t cycles)
+{
+    return ((double) size * (double) CRYP_MODEL_HZ) / ((double) cycles * 1e6);
+}
+
+static int fails;
+
+static int bench_run(uint32_t m, enum crypto_key_len key_len, enum crypto_dir dir,
+                     uint32_t max_size, bool quiet)
+{
+    static const uint8_t key[32] = {
+        0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+        0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+    };
+    /* the core only increments the last counter word: keep clear of its wrap */
+    static const uint8_t iv[16] = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0x00, 0x00, 0x00, 0x01
+    };
+    enum crypto_algo mode = bench_modes[m].mode;
+    const uint8_t *ivp = bench_modes[m].has_iv ? iv : NULL;
+    unsigned int iv_len = (bench_modes[m].block == 8) ? 8 : 16;
+    bench_cost_t cold, warm, pio, dma;
+    uint32_t crossover = 0;
+    uint32_t size;
+
+    /* setup: first init with this key (load and, if needed, prepare), then a re-init */
+    cryp_key_invalidate();
+    bench_mark(&cold);
+    cryp_init(key, key_len, ivp, iv_len, mode, dir);
+    bench_since(&cold);
+    bench_mark(&warm);
+    cryp_init(key, key_len, ivp, iv_len, mode, dir);
+    bench_since(&warm);
+    printf("%-8s %3u %s  init: %llu cycles %lu/%lu r/w (key load%s), "
+           "%llu cycles %lu/%lu r/w (key in place)\n",
+           bench_modes[m].name, (mode >= AES_ECB) ? 128 + 64 * key_len : (mode < DES_ECB) ? 192 : 64,
+           (dir == ENCRYPT) ? "enc" : "dec", (unsigned long long) cold.cycles, cold.reads, cold.writes,
+           ((dir == DECRYPT) && (mode != AES_CTR) && (mode >= AES_ECB)) ? " + prepare" : "",
+           (unsigned long long) warm.cycles, warm.reads, warm.writes);
+
+    for (size = 16; size <= max_size; size *= 2) {
+        bench_reference(mode, key_len, dir, key, iv, size);
+
+        cryp_init(key, key_len, ivp, iv_len, mode, dir);
+        memset(bench_out, 0, size);
+        bench_mark(&pio);
+        cryp_do_no_dma(bench_in, bench_out, size);
+        bench_since(&pio);
+        if (memcmp(bench_out, bench_ref, size)) {
+            printf("FAIL: %s direct access, %u bytes\n", bench_modes[m].name, size);
+            fails++;
+        }
+
+        cryp_init(key, key_len, ivp, iv_len, mode, dir);
+        memset(bench_out, 0, size);
+        dma_done = false;
+        bench_mark(&dma);
+        if (cryp_do_dma(bench_in, bench_out, size, dma_in_desc, dma_out_desc) == 0) {
+            cryp_model_dma_run(1000ULL * size + 100000);
+        }
+        bench_since(&dma);
+        if (!dma_done || memcmp(bench_out, bench_ref, size)) {
+            printf("FAIL: %s DMA, %u bytes\n", bench_modes[m].name, size);
+            fails++;
+        }
+
+        if ((crossover == 0) && (dma.cycles < pio.cycles)) {
+            crossover = size;
+        }
+        if (!quiet) {
+            printf("  %8u B  pio %9llu cyc %7.2f MB/s %6lu SR polls %7lu/%-7lu r/w  |  "
+                   "dma %9llu cyc %7.2f MB/s %3lu syscalls %3lu/%-3lu r/w\n",
+                   size, (unsigned long long) pio.cycles, bench_mbps(size, pio.cycles), pio.sr_reads,
+                   pio.reads, pio.writes,
+                   (unsigned long long) dma.cycles, bench_mbps(size, dma.cycles), dma.syscalls,
+                   dma.reads, dma.writes);
+        }
+    }
+    if (crossover) {
+        printf("  DMA faster from %u bytes\n", crossover);
+    } else {
+        printf("  direct access faster up to %u bytes\n", max_size);
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("usage: %s [-m max_size] [-a access_cycles] [-d dma_word_cycles] "
+           "[-s syscall_cycles] [-q]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t max_size = 256 * 1024;
+    bool quiet = false;
+    uint32_t m, d, k;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:a:d:s:qh")) != -1) {
+        switch (opt) {
+        case 'm':
+            max_size = (uint32_t) strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            cryp_model_timing.access = (uint32_t) strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            cryp_model_timing.dma_word = (uint32_t) strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            cryp_model_timing.syscall = (uint32_t) strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_size < 16) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bench_in = malloc(max_size);
+    bench_out = malloc(max_size);
+    bench_ref = malloc(max_size);
+    if (!bench_in || !bench_out || !bench_ref) {
+        return 1;
+    }
+    for (m = 0; m < max_size; m++) {
+        bench_in[m] = (uint8_t)(m * 131 + (m >> 8));
+    }
+
+    cryp_model_reset();
+    if (cryp_early_init(true, CRYP_MAP_AUTO, CRYP_CFG, &dma_in_desc, &dma_out_desc) ||
+        cryp_init_dma(bench_dma_in, bench_dma_out, dma_in_desc, dma_out_desc)) {
+        printf("FAIL: driver init\n");
+        return 1;
+    }
+    printf("model: %u cycles/access, %u cycles/DMA word, %u cycles/syscall, %llu Hz\n",
+           cryp_model_timing.access, cryp_model_timing.dma_word, cryp_model_timing.syscall,
+           (unsigned long long) CRYP_MODEL_HZ);
+
+    for (m = 0; m < BENCH_MODES; m++) {
+        for (d = 0; d < 2; d++) {
+            if (bench_modes[m].mode < AES_ECB) {
+                bench_run(m, KEY_192, (enum crypto_dir) d, max_size, quiet);
+                continue;
+            }
+            for (k = KEY_128; k <= KEY_256; k++) {
+                bench_run(m, (enum crypto_key_len) k, (enum crypto_dir) d, max_size, quiet);
+            }
+        }
+    }
+    printf("%s\n", fails ? "FAILED" : "all outputs match libcrypto");
+    return fails ? 1 : 0;
+}
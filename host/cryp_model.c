@@ -0,0 +1,950 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "cryp_model.h"
+#include "cryp_regs.h"
+#include "libc/regutils.h"
+#include "libc/syscall.h"
+
+/*
+ * Default timings: the core latencies are the STM32F4 reference manual
+ * figures, the bus and syscall costs rough estimates for a 168 MHz core.
+ */
+cryp_model_timing_t cryp_model_timing = {
+    .access   = 2,
+    .dma_word = 2,
+    .syscall  = 1000,
+    .aes      = { 14, 16, 18 },
+    .des      = 16,
+    .tdes     = 48
+};
+
+cryp_model_stats_t cryp_model_stats;
+
+#define CRYP_MODEL_FIFO_WORDS   8
+
+enum cryp_model_task {
+    CORE_IDLE,
+    CORE_BLOCK,
+    CORE_KEY_PREPARE,
+    CORE_AEAD_INIT
+};
+
+/*
+ * Peripheral state. The GCM/CCM context registers hold, in this model, the
+ * running GHASH (GCM) or CBC-MAC (CCM) in ctx[0..3], J0 in ctx[4..7] and H
+ * in ctx[8..11]: the driver only saves and restores them as a whole.
+ */
+static struct {
+    uint32_t             cr;
+    uint32_t             dmacr;
+    uint32_t             imscr;
+    uint32_t             key[8];
+    uint32_t             iv[4];
+    uint32_t             ctx[16];
+    uint32_t             in[CRYP_MODEL_FIFO_WORDS];
+    uint32_t             in_n;
+    uint32_t             out[CRYP_MODEL_FIFO_WORDS];
+    uint32_t             out_n;
+    uint32_t             pending[4];     /* output of the block being processed */
+    uint32_t             pending_n;
+    uint32_t             busy;           /* cycles left for the current task */
+    enum cryp_model_task task;
+    bool                 prepared;       /* key registers in decryption form */
+    bool                 mapped;
+    bool                 map_auto;
+    user_handler_t       isr;
+    bool                 in_isr;
+} cryp;
+
+/* the two CRYP DMA streams, in sys_init(INIT_DMA) order */
+#define CRYP_MODEL_DMA_STREAMS  2
+
+static struct {
+    bool     declared;
+    dma_t    cfg;
+    bool     enabled;
+    uint32_t done;              /* words moved */
+} dma[CRYP_MODEL_DMA_STREAMS];
+
+static void model_fatal(const char *what)
+{
+    fprintf(stderr, "cryp model: %s\n", what);
+    abort();
+}
+
+/*
+ * Crypto primitives
+ */
+static void be32_put(uint8_t * b, uint32_t w)
+{
+    b[0] = (uint8_t)(w >> 24);
+    b[1] = (uint8_t)(w >> 16);
+    b[2] = (uint8_t)(w >> 8);
+    b[3] = (uint8_t) w;
+}
+
+static uint32_t be32_get(const uint8_t * b)
+{
+    return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | b[3];
+}
+
+/* ECB block function, contexts being kept as long as the key does not change */
+static void model_ecb(const EVP_CIPHER * cipher, bool decrypt, const uint8_t * key,
+                      uint32_t key_len, const uint8_t * in, uint8_t * out)
+{
+    static EVP_CIPHER_CTX *ctx[2];
+    static const EVP_CIPHER *ctx_cipher[2];
+    static uint8_t ctx_key[2][32];
+    int i = decrypt ? 1 : 0;
+    int len;
+
+    if (ctx[i] == NULL) {
+        ctx[i] = EVP_CIPHER_CTX_new();
+    }
+    if ((ctx_cipher[i] != cipher) || memcmp(ctx_key[i], key, key_len)) {
+        EVP_CipherInit_ex(ctx[i], cipher, NULL, key, NULL, decrypt ? 0 : 1);
+        EVP_CIPHER_CTX_set_padding(ctx[i], 0);
+        ctx_cipher[i] = cipher;
+        memcpy(ctx_key[i], key, key_len);
+    }
+    if (!EVP_CipherUpdate(ctx[i], out, &len, in, (int) EVP_CIPHER_block_size(cipher))) {
+        model_fatal("block cipher failure");
+    }
+}
+
+static uint32_t model_mode(void)
+{
+    return ((cryp.cr & CRYP_CR_ALGOMODE_Msk) >> CRYP_CR_ALGOMODE_Pos) |
+           (((cryp.cr & CRYP_CR_ALGOMODE3_Msk) >> CRYP_CR_ALGOMODE3_Pos) << 3);
+}
+
+static uint32_t model_phase(void)
+{
+    return (cryp.cr & CRYP_CR_GCM_CCMPH_Msk) >> CRYP_CR_GCM_CCMPH_Pos;
+}
+
+static bool model_aead(void)
+{
+    return (model_mode() & 8) != 0;
+}
+
+static uint32_t model_keysize(void)
+{
+    return (cryp.cr & CRYP_CR_KEYSIZE_Msk) >> CRYP_CR_KEYSIZE_Pos;
+}
+
+/* AES key from the key registers: K2-K3 for 128 bits, K1-K3 for 192, K0-K3 for 256 */
+static void model_aes(bool decrypt, const uint8_t * in, uint8_t * out)
+{
+    static const uint32_t first[3] = { 4, 2, 0 };
+    const EVP_CIPHER *cipher[3] = { EVP_aes_128_ecb(), EVP_aes_192_ecb(), EVP_aes_256_ecb() };
+    uint32_t ks = model_keysize();
+    uint8_t key[32];
+    uint32_t i;
+
+    if (ks > 2) {
+        model_fatal("reserved key size");
+    }
+    for (i = first[ks]; i < 8; i++) {
+        be32_put(key + 4 * (i - first[ks]), cryp.key[i]);
+    }
+    model_ecb(cipher[ks], decrypt, key, 32 - 4 * first[ks], in, out);
+}
+
+/* TDES uses K1-K3, DES only K1 (EDE with K1 three times) */
+static void model_des(bool tdes, bool decrypt, const uint8_t * in, uint8_t * out)
+{
+    uint8_t key[24];
+    uint32_t i;
+
+    for (i = 0; i < 6; i++) {
+        be32_put(key + 4 * i, cryp.key[tdes ? (2 + i) : (2 + (i % 2))]);
+    }
+    model_ecb(EVP_des_ede3_ecb(), decrypt, key, sizeof(key), in, out);
+}
+
+/* data swapping between the FIFOs and the core, see CRYP_CR_DATATYPE */
+static uint32_t model_swap(uint32_t w)
+{
+    uint32_t r = 0;
+    uint32_t i;
+
+    switch ((cryp.cr & CRYP_CR_DATATYPE_Msk) >> CRYP_CR_DATATYPE_Pos) {
+    case CRYP_CR_DATATYPE_WORDS:
+        return w;
+    case CRYP_CR_DATATYPE_HALF_WORDS:
+        return (w << 16) | (w >> 16);
+    case CRYP_CR_DATATYPE_BYTES:
+        return __builtin_bswap32(w);
+    default:
+        for (i = 0; i < 32; i++) {
+            if (w & (1u << i)) {
+                r |= 1u << (31 - i);
+            }
+        }
+        return r;
+    }
+}
+
+static void model_ctx_get(uint32_t base, uint8_t * b)
+{
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        be32_put(b + 4 * i, cryp.ctx[base + i]);
+    }
+}
+
+static void model_ctx_put(uint32_t base, const uint8_t * b)
+{
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        cryp.ctx[base + i] = be32_get(b + 4 * i);
+    }
+}
+
+static void model_iv_get(uint8_t * b)
+{
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        be32_put(b + 4 * i, cryp.iv[i]);
+    }
+}
+
+/* GCM: running GHASH ^= block, times H */
+static void model_ghash(const uint8_t * blk)
+{
+    uint8_t x[16], h[16], z[16], v[16];
+    uint32_t i, j;
+    bool lsb;
+
+    model_ctx_get(0, x);
+    model_ctx_get(8, h);
+    for (i = 0; i < 16; i++) {
+        x[i] ^= blk[i];
+    }
+    memset(z, 0, sizeof(z));
+    memcpy(v, h, sizeof(v));
+    for (i = 0; i < 128; i++) {
+        if (x[i / 8] & (0x80 >> (i % 8))) {
+            for (j = 0; j < 16; j++) {
+                z[j] ^= v[j];
+            }
+        }
+        lsb = v[15] & 1;
+        for (j = 15; j > 0; j--) {
+            v[j] = (uint8_t)((v[j] >> 1) | (v[j - 1] << 7));
+        }
+        v[0] >>= 1;
+        if (lsb) {
+            v[0] ^= 0xe1;
+        }
+    }
+    model_ctx_put(0, z);
+}
+
+/* CCM: running CBC-MAC */
+static void model_cbcmac(const uint8_t * blk)
+{
+    uint8_t s[16];
+    uint32_t i;
+
+    model_ctx_get(0, s);
+    for (i = 0; i < 16; i++) {
+        s[i] ^= blk[i];
+    }
+    model_aes(false, s, s);
+    model_ctx_put(0, s);
+}
+
+/* end of the GCM/CCM init phase, the core clearing CRYPEN */
+static void model_aead_init(void)
+{
+    uint8_t blk[16], t[16];
+    uint32_t i;
+
+    memset(cryp.ctx, 0, sizeof(cryp.ctx));
+    if (model_mode() == 8) {
+        memset(blk, 0, sizeof(blk));
+        model_aes(false, blk, t);
+        model_ctx_put(8, t);
+        /* the IV registers hold the first counter block, J0 + 1 */
+        model_iv_get(blk);
+        if (blk[15] == 0) {
+            model_fatal("GCM counter block wraps");
+        }
+        blk[15]--;
+        model_ctx_put(4, blk);
+    } else {
+        /* CCM: B0 is the first block of the input FIFO */
+        if (cryp.in_n < 4) {
+            model_fatal("CCM init phase without B0");
+        }
+        for (i = 0; i < 4; i++) {
+            be32_put(blk + 4 * i, model_swap(cryp.in[i]));
+        }
+        memmove(cryp.in, cryp.in + 4, (cryp.in_n - 4) * 4);
+        cryp.in_n -= 4;
+        model_aes(false, blk, t);
+        model_ctx_put(0, t);
+    }
+    cryp.cr &= ~CRYP_CR_CRYPEN_Msk;
+}
+
+/*
+ * Core
+ */
+static uint32_t model_block_words(void)
+{
+    return (model_mode() < CRYP_CR_ALGOMODE_AES_ECB) ? 2 : 4;
+}
+
+static uint32_t model_latency(void)
+{
+    uint32_t mode = model_mode();
+
+    if (mode < CRYP_CR_ALGOMODE_DES_ECB) {
+        return cryp_model_timing.tdes;
+    }
+    if (mode < CRYP_CR_ALGOMODE_AES_ECB) {
+        return cryp_model_timing.des;
+    }
+    return cryp_model_timing.aes[model_keysize() % 3];
+}
+
+/* a block can be taken from the input FIFO */
+static bool model_core_ready(void)
+{
+    uint32_t bw = model_block_words();
+
+    if (!(cryp.cr & CRYP_CR_CRYPEN_Msk) || (model_mode() == CRYP_CR_ALGOMODE_AES_KEY_PREPARE)) {
+        return false;
+    }
+    if (model_aead() && (model_phase() == CRYP_CR_GCM_CCMPH_INIT)) {
+        return false;
+    }
+    return (cryp.in_n >= bw) && ((cryp.out_n + bw) <= CRYP_MODEL_FIFO_WORDS);
+}
+
+/* GCM/CCM header, payload and final phases */
+static void model_aead_block(const uint8_t * in, uint8_t * out, bool decrypt)
+{
+    uint8_t ks[16], s[16], t[16];
+    uint32_t i;
+
+    switch (model_phase()) {
+    case CRYP_CR_GCM_CCMPH_HEADER:
+        if (model_mode() == 8) {
+            model_ghash(in);
+        } else {
+            model_cbcmac(in);
+        }
+        cryp.pending_n = 0;
+        return;
+    case CRYP_CR_GCM_CCMPH_PAYLOAD:
+        model_iv_get(t);
+        model_aes(false, t, ks);
+        cryp.iv[3]++;
+        for (i = 0; i < 16; i++) {
+            out[i] = in[i] ^ ks[i];
+        }
+        if (model_mode() == 8) {
+            model_ghash(decrypt ? in : out);
+        } else {
+            model_cbcmac(decrypt ? out : in);
+        }
+        break;
+    default:
+        if (model_mode() == 8) {
+            model_ghash(in);
+            model_ctx_get(4, t);
+            model_aes(false, t, ks);
+        } else {
+            model_aes(false, in, ks);
+        }
+        model_ctx_get(0, s);
+        for (i = 0; i < 16; i++) {
+            out[i] = s[i] ^ ks[i];
+        }
+        break;
+    }
+    cryp.pending_n = 4;
+}
+
+static void model_core_block(void)
+{
+    uint32_t bw = model_block_words();
+    uint32_t mode = model_mode();
+    bool decrypt = (cryp.cr & CRYP_CR_ALGODIR_Msk) != 0;
+    bool cbc = (mode == CRYP_CR_ALGOMODE_TDES_CBC) || (mode == CRYP_CR_ALGOMODE_DES_CBC) ||
+               (mode == CRYP_CR_ALGOMODE_AES_CBC);
+    uint8_t in[16], out[16], iv[16], t[16];
+    uint32_t bytes = bw * 4;
+    uint32_t i;
+
+    for (i = 0; i < bw; i++) {
+        be32_put(in + 4 * i, model_swap(cryp.in[i]));
+    }
+    memmove(cryp.in, cryp.in + bw, (cryp.in_n - bw) * 4);
+    cryp.in_n -= bw;
+    model_iv_get(iv);
+    cryp.pending_n = bw;
+
+    if (model_aead()) {
+        model_aead_block(in, out, decrypt);
+    } else if (mode == CRYP_CR_ALGOMODE_AES_CTR) {
+        model_aes(false, iv, t);
+        cryp.iv[3]++;
+        for (i = 0; i < 16; i++) {
+            out[i] = in[i] ^ t[i];
+        }
+    } else if (decrypt) {
+        if (mode >= CRYP_CR_ALGOMODE_AES_ECB) {
+            model_aes(true, in, out);
+            /* as on the hardware, a raw key gives garbage */
+            if (!cryp.prepared) {
+                for (i = 0; i < 16; i++) {
+                    out[i] ^= 0xa5;
+                }
+            }
+        } else {
+            model_des(mode < CRYP_CR_ALGOMODE_DES_ECB, true, in, out);
+        }
+        if (cbc) {
+            for (i = 0; i < bytes; i++) {
+                out[i] ^= iv[i];
+            }
+            for (i = 0; i < bw; i++) {
+                cryp.iv[i] = be32_get(in + 4 * i);
+            }
+        }
+    } else {
+        memcpy(t, in, bytes);
+        if (cbc) {
+            for (i = 0; i < bytes; i++) {
+                t[i] ^= iv[i];
+            }
+        }
+        if (mode >= CRYP_CR_ALGOMODE_AES_ECB) {
+            model_aes(false, t, out);
+        } else {
+            model_des(mode < CRYP_CR_ALGOMODE_DES_ECB, false, t, out);
+        }
+        if (cbc) {
+            for (i = 0; i < bw; i++) {
+                cryp.iv[i] = be32_get(out + 4 * i);
+            }
+        }
+    }
+
+    for (i = 0; i < cryp.pending_n; i++) {
+        cryp.pending[i] = model_swap(be32_get(out + 4 * i));
+    }
+    cryp.task = CORE_BLOCK;
+    cryp.busy = model_latency();
+    cryp_model_stats.blocks++;
+}
+
+static void model_core_done(void)
+{
+    switch (cryp.task) {
+    case CORE_BLOCK:
+        memcpy(cryp.out + cryp.out_n, cryp.pending, cryp.pending_n * 4);
+        cryp.out_n += cryp.pending_n;
+        cryp.pending_n = 0;
+        break;
+    case CORE_KEY_PREPARE:
+        cryp.prepared = true;
+        break;
+    case CORE_AEAD_INIT:
+        model_aead_init();
+        break;
+    default:
+        break;
+    }
+    cryp.task = CORE_IDLE;
+}
+
+static uint32_t model_risr(void)
+{
+    uint32_t risr = 0;
+
+    if (cryp.in_n < (CRYP_MODEL_FIFO_WORDS / 2)) {
+        risr |= CRYP_RISR_INRIS_Msk;
+    }
+    if (cryp.out_n > 0) {
+        risr |= CRYP_RISR_OUTRIS_Msk;
+    }
+    return risr;
+}
+
+/* the kernel posthook saves MISR and masks IMSCR before the user ISR runs */
+static void model_irq(void)
+{
+    uint32_t misr = model_risr() & cryp.imscr;
+
+    if ((cryp.isr == NULL) || cryp.in_isr || (misr == 0)) {
+        return;
+    }
+    cryp.imscr = 0;
+    cryp.in_isr = true;
+    cryp_model_stats.irqs++;
+    cryp.isr(CRYP_IRQ, misr, 0);
+    cryp.in_isr = false;
+}
+
+/* let @cycles elapse */
+static void model_advance(uint32_t cycles)
+{
+    uint32_t step;
+
+    cryp_model_stats.cycles += cycles;
+    while (cycles > 0) {
+        if (cryp.task == CORE_IDLE) {
+            if (!model_core_ready()) {
+                break;
+            }
+            model_core_block();
+        }
+        step = (cycles < cryp.busy) ? cycles : cryp.busy;
+        cryp.busy -= step;
+        cycles -= step;
+        if (cryp.busy == 0) {
+            model_core_done();
+        }
+    }
+    model_irq();
+}
+
+static uint32_t model_sr(void)
+{
+    uint32_t sr = 0;
+
+    if (cryp.in_n == 0) {
+        sr |= CRYP_SR_IFEM_Msk;
+    }
+    if (cryp.in_n < CRYP_MODEL_FIFO_WORDS) {
+        sr |= CRYP_SR_IFNF_Msk;
+    }
+    if (cryp.out_n > 0) {
+        sr |= CRYP_SR_OFNE_Msk;
+    }
+    if (cryp.out_n == CRYP_MODEL_FIFO_WORDS) {
+        sr |= CRYP_SR_OFFU_Msk;
+    }
+    if ((cryp.task != CORE_IDLE) || model_core_ready()) {
+        sr |= CRYP_SR_BUSY_Msk;
+    }
+    return sr;
+}
+
+static uint32_t model_pop_out(void)
+{
+    uint32_t w = cryp.out[0];
+
+    memmove(cryp.out, cryp.out + 1, (cryp.out_n - 1) * 4);
+    cryp.out_n--;
+    return w;
+}
+
+/*
+ * Register accesses
+ */
+static uint32_t model_offset(volatile uint32_t * reg)
+{
+    if (!cryp.mapped) {
+        model_fatal("register access while the device is not mapped");
+    }
+    return (uint32_t)((uintptr_t) reg - CRYP_BASE);
+}
+
+uint32_t cryp_model_read(volatile uint32_t * reg)
+{
+    uint32_t off = model_offset(reg);
+
+    cryp_model_stats.reads++;
+    model_advance(cryp_model_timing.access);
+
+    switch (off) {
+    case 0x00:
+        return cryp.cr;
+    case 0x04:
+        cryp_model_stats.sr_reads++;
+        return model_sr();
+    case 0x0c:
+        cryp_model_stats.dout_reads++;
+        /* the bus waits for a block in progress */
+        while ((cryp.out_n == 0) && (model_sr() & CRYP_SR_BUSY_Msk)) {
+            cryp_model_stats.dout_stalls++;
+            model_advance(1);
+        }
+        if (cryp.out_n == 0) {
+            model_fatal("DOUT read while the output FIFO is empty");
+        }
+        return model_pop_out();
+    case 0x10:
+        return cryp.dmacr;
+    case 0x14:
+        return cryp.imscr;
+    case 0x18:
+        return model_risr();
+    case 0x1c:
+        return model_risr() & cryp.imscr;
+    default:
+        break;
+    }
+    if ((off >= 0x20) && (off < 0x40)) {
+        return cryp.key[(off - 0x20) / 4];
+    }
+    if ((off >= 0x40) && (off < 0x50)) {
+        return cryp.iv[(off - 0x40) / 4];
+    }
+    if ((off >= 0x50) && (off < 0x90)) {
+        return cryp.ctx[(off - 0x50) / 4];
+    }
+    model_fatal("read of an unknown register");
+    return 0;
+}
+
+uint32_t cryp_model_peek(uint32_t off)
+{
+    switch (off) {
+    case 0x00:
+        return cryp.cr;
+    case 0x04:
+        return model_sr();
+    case 0x0c:
+        return (cryp.out_n > 0) ? cryp.out[0] : 0;
+    case 0x10:
+        return cryp.dmacr;
+    case 0x14:
+        return cryp.imscr;
+    case 0x18:
+        return model_risr();
+    case 0x1c:
+        return model_risr() & cryp.imscr;
+    default:
+        break;
+    }
+    if ((off >= 0x20) && (off < 0x40)) {
+        return cryp.key[(off - 0x20) / 4];
+    }
+    if ((off >= 0x40) && (off < 0x50)) {
+        return cryp.iv[(off - 0x40) / 4];
+    }
+    if ((off >= 0x50) && (off < 0x90)) {
+        return cryp.ctx[(off - 0x50) / 4];
+    }
+    return 0;
+}
+
+static void model_write_cr(uint32_t value)
+{
+    uint32_t old = cryp.cr;
+    bool enabling;
+
+    cryp_model_stats.cr_writes++;
+    if (value & CRYP_CR_FFLUSH_Msk) {
+        cryp.in_n = 0;
+        cryp.out_n = 0;
+    }
+    cryp.cr = value & ~CRYP_CR_FFLUSH_Msk;
+    enabling = !(old & CRYP_CR_CRYPEN_Msk) && (cryp.cr & CRYP_CR_CRYPEN_Msk);
+
+    if (model_aead() && ((old ^ cryp.cr) & CRYP_CR_GCM_CCMPH_Msk) &&
+        (old & CRYP_CR_CRYPEN_Msk) && (cryp.cr & CRYP_CR_CRYPEN_Msk)) {
+        model_fatal("GCM/CCM phase changed while enabled");
+    }
+    if (!enabling) {
+        return;
+    }
+    if (model_mode() == CRYP_CR_ALGOMODE_AES_KEY_PREPARE) {
+        cryp_model_stats.key_prepares++;
+        cryp.prepared = false;
+        cryp.task = CORE_KEY_PREPARE;
+        cryp.busy = model_latency();
+    } else if (model_aead() && (model_phase() == CRYP_CR_GCM_CCMPH_INIT)) {
+        cryp.task = CORE_AEAD_INIT;
+        cryp.busy = model_latency();
+    }
+}
+
+void cryp_model_write(volatile uint32_t * reg, uint32_t value)
+{
+    uint32_t off = model_offset(reg);
+
+    cryp_model_stats.writes++;
+    model_advance(cryp_model_timing.access);
+
+    switch (off) {
+    case 0x00:
+        model_write_cr(value);
+        return;
+    case 0x08:
+        cryp_model_stats.din_writes++;
+        if (cryp.in_n == CRYP_MODEL_FIFO_WORDS) {
+            model_fatal("DIN written while the input FIFO is full");
+        }
+        cryp.in[cryp.in_n++] = value;
+        return;
+    case 0x10:
+        cryp.dmacr = value;
+        return;
+    case 0x14:
+        cryp.imscr = value;
+        model_irq();
+        return;
+    default:
+        break;
+    }
+    if ((off >= 0x20) && (off < 0x40)) {
+        cryp_model_stats.key_writes++;
+        cryp.key[(off - 0x20) / 4] = value;
+        cryp.prepared = false;
+    } else if ((off >= 0x40) && (off < 0x50)) {
+        cryp_model_stats.iv_writes++;
+        cryp.iv[(off - 0x40) / 4] = value;
+    } else if ((off >= 0x50) && (off < 0x90)) {
+        cryp.ctx[(off - 0x50) / 4] = value;
+    } else {
+        model_fatal("write of an unknown register");
+    }
+}
+
+/*
+ * DMA streams, running while the task waits in cryp_model_dma_run()
+ */
+static bool model_dma_step(void)
+{
+    bool moved = false;
+    uint32_t i, w;
+    physaddr_t addr;
+
+    for (i = 0; i < CRYP_MODEL_DMA_STREAMS; i++) {
+        if (!dma[i].enabled) {
+            continue;
+        }
+        if (dma[i].cfg.dir == MEMORY_TO_PERIPHERAL) {
+            addr = dma[i].cfg.in_addr + (4 * dma[i].done);
+            if (!(cryp.dmacr & CRYP_DMACR_DIEN_Msk) || (cryp.in_n == CRYP_MODEL_FIFO_WORDS)) {
+                continue;
+            }
+            if (addr % 4) {
+                model_fatal("unaligned DMA address");
+            }
+            memcpy(&w, (const void *) addr, 4);
+            cryp.in[cryp.in_n++] = w;
+        } else {
+            addr = dma[i].cfg.out_addr + (4 * dma[i].done);
+            if (!(cryp.dmacr & CRYP_DMACR_DOEN_Msk) || (cryp.out_n == 0)) {
+                continue;
+            }
+            if (addr % 4) {
+                model_fatal("unaligned DMA address");
+            }
+            w = model_pop_out();
+            memcpy((void *) addr, &w, 4);
+        }
+        moved = true;
+        model_advance(cryp_model_timing.dma_word);
+        if (++dma[i].done == (dma[i].cfg.size / 4U)) {
+            dma[i].enabled = false;
+            if (dma[i].cfg.dir == MEMORY_TO_PERIPHERAL) {
+                if (dma[i].cfg.in_handler) {
+                    dma[i].cfg.in_handler(0, 0);
+                }
+            } else if (dma[i].cfg.out_handler) {
+                dma[i].cfg.out_handler(0, 0);
+            }
+        }
+    }
+    return moved;
+}
+
+bool cryp_model_dma_active(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < CRYP_MODEL_DMA_STREAMS; i++) {
+        if (dma[i].enabled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cryp_model_dma_run(uint64_t max_cycles)
+{
+    uint64_t end = cryp_model_stats.cycles + max_cycles;
+
+    while (cryp_model_dma_active() && (cryp_model_stats.cycles < end)) {
+        if (!model_dma_step()) {
+            model_advance(1);
+        }
+    }
+    return cryp_model_dma_active();
+}
+
+/*
+ * Syscalls
+ */
+e_syscall_ret sys_init(e_init_type type, ...)
+{
+    e_syscall_ret ret = SYS_E_DONE;
+    device_t *dev;
+    dma_t *cfg;
+    int *desc;
+    int i;
+    va_list ap;
+
+    cryp_model_stats.syscalls++;
+    model_advance(cryp_model_timing.syscall);
+    va_start(ap, type);
+    switch (type) {
+    case INIT_DEVACCESS:
+        dev = va_arg(ap, device_t *);
+        desc = va_arg(ap, int *);
+        cryp.isr = (dev->irq_num > 0) ? dev->irqs[0].handler : NULL;
+        cryp.map_auto = (dev->map_mode == DEV_MAP_AUTO);
+        cryp.mapped = cryp.map_auto;
+        *desc = 0;
+        break;
+    case INIT_DMA:
+        cfg = va_arg(ap, dma_t *);
+        desc = va_arg(ap, int *);
+        for (i = 0; (i < CRYP_MODEL_DMA_STREAMS) && dma[i].declared; i++) {
+        }
+        if (i == CRYP_MODEL_DMA_STREAMS) {
+            ret = SYS_E_DENIED;
+            break;
+        }
+        dma[i].declared = true;
+        dma[i].cfg = *cfg;
+        *desc = i;
+        break;
+    default:
+        break;
+    }
+    va_end(ap);
+    return ret;
+}
+
+e_syscall_ret sys_cfg(e_cfg_type type, ...)
+{
+    e_syscall_ret ret = SYS_E_DONE;
+    dma_t *cfg;
+    uint8_t mask;
+    int desc;
+    va_list ap;
+
+    cryp_model_stats.syscalls++;
+    model_advance(cryp_model_timing.syscall);
+    va_start(ap, type);
+    switch (type) {
+    case CFG_DMA_RECONF:
+        cfg = va_arg(ap, dma_t *);
+        mask = (uint8_t) va_arg(ap, int);
+        desc = va_arg(ap, int);
+        if ((desc < 0) || (desc >= CRYP_MODEL_DMA_STREAMS) || !dma[desc].declared) {
+            ret = SYS_E_INVAL;
+            break;
+        }
+        cryp_model_stats.dma_reconf++;
+        if (mask & DMA_RECONF_BUFIN) {
+            dma[desc].cfg.in_addr = cfg->in_addr;
+        }
+        if (mask & DMA_RECONF_BUFOUT) {
+            dma[desc].cfg.out_addr = cfg->out_addr;
+        }
+        if (mask & DMA_RECONF_BUFSIZE) {
+            dma[desc].cfg.size = cfg->size;
+        }
+        if (mask & DMA_RECONF_HANDLERS) {
+            dma[desc].cfg.in_handler = cfg->in_handler;
+            dma[desc].cfg.out_handler = cfg->out_handler;
+        }
+        if (mask & DMA_RECONF_MODE) {
+            dma[desc].cfg.mode = cfg->mode;
+        }
+        if (mask & DMA_RECONF_PRIO) {
+            dma[desc].cfg.in_prio = cfg->in_prio;
+            dma[desc].cfg.out_prio = cfg->out_prio;
+        }
+        /* a buffer reconfiguration starts the stream */
+        if ((mask & (DMA_RECONF_BUFIN | DMA_RECONF_BUFOUT | DMA_RECONF_BUFSIZE)) &&
+            (dma[desc].cfg.size > 0)) {
+            dma[desc].enabled = true;
+            dma[desc].done = 0;
+        }
+        break;
+    case CFG_DMA_RELOAD:
+        desc = va_arg(ap, int);
+        if ((desc < 0) || (desc >= CRYP_MODEL_DMA_STREAMS) || !dma[desc].declared) {
+            ret = SYS_E_INVAL;
+            break;
+        }
+        cryp_model_stats.dma_reload++;
+        dma[desc].enabled = true;
+        dma[desc].done = 0;
+        break;
+    case CFG_DMA_DISABLE:
+        desc = va_arg(ap, int);
+        if ((desc >= 0) && (desc < CRYP_MODEL_DMA_STREAMS)) {
+            dma[desc].enabled = false;
+        }
+        break;
+    case CFG_DEV_MAP:
+    case CFG_DEV_UNMAP:
+        cryp_model_stats.dev_map++;
+        if (cryp.map_auto) {
+            ret = SYS_E_DENIED;
+            break;
+        }
+        cryp.mapped = (type == CFG_DEV_MAP);
+        break;
+    default:
+        ret = SYS_E_INVAL;
+        break;
+    }
+    va_end(ap);
+    return ret;
+}
+
+e_syscall_ret sys_get_systick(uint64_t * val, e_tick_type type)
+{
+    uint64_t cycles;
+
+    cryp_model_stats.syscalls++;
+    model_advance(cryp_model_timing.syscall);
+    cycles = cryp_model_stats.cycles;
+    switch (type) {
+    case PREC_MILLI:
+        *val = (cycles * 1000) / CRYP_MODEL_HZ;
+        break;
+    case PREC_MICRO:
+        *val = (cycles * 1000000) / CRYP_MODEL_HZ;
+        break;
+    default:
+        *val = cycles;
+        break;
+    }
+    return SYS_E_DONE;
+}
+
+bool cryp_model_mapped(void)
+{
+    return cryp.mapped;
+}
+
+void cryp_model_reset(void)
+{
+    memset(&cryp, 0, sizeof(cryp));
+    memset(dma, 0, sizeof(dma));
+    memset(&cryp_model_stats, 0, sizeof(cryp_model_stats));
+}
@@ -0,0 +1,74 @@
+#ifndef CRYP_MODEL_H
+#define CRYP_MODEL_H
+
+/*
+ * Register level model of the STM32F4 CRYP peripheral, its two DMA streams
+ * and the EwoK syscalls used by libcryp, so that the driver sources can be
+ * linked unchanged on a Linux host (see host/Makefile).
+ *
+ * Time is counted in core cycles: each CRYP register access, each word
+ * moved by a DMA stream and each syscall advances the model clock, and the
+ * core processes a block in the number of cycles given by the reference
+ * manual for the configured algorithm. The figures are only as good as
+ * the timing parameters below, which can be tuned to the target.
+ */
+#include "libc/types.h"
+
+typedef struct {
+    uint32_t access;            /* per CRYP register access */
+    uint32_t dma_word;          /* per word moved by a DMA stream */
+    uint32_t syscall;           /* per sys_cfg()/sys_get_systick() call */
+    uint32_t aes[3];            /* per AES block (and key preparation), 128/192/256 bits keys */
+    uint32_t des;               /* per DES block */
+    uint32_t tdes;              /* per TDES block */
+} cryp_model_timing_t;
+
+typedef struct {
+    uint64_t      cycles;
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long sr_reads;
+    unsigned long din_writes;
+    unsigned long dout_reads;
+    unsigned long dout_stalls;  /* cycles DOUT reads waited for the core */
+    unsigned long cr_writes;
+    unsigned long key_writes;
+    unsigned long iv_writes;
+    unsigned long blocks;
+    unsigned long key_prepares;
+    unsigned long irqs;
+    unsigned long syscalls;
+    unsigned long dma_reconf;
+    unsigned long dma_reload;
+    unsigned long dev_map;      /* CFG_DEV_MAP and CFG_DEV_UNMAP */
+} cryp_model_stats_t;
+
+/* core clock used to convert cycles to time (sys_get_systick()) */
+#define CRYP_MODEL_HZ   168000000ULL
+
+extern cryp_model_timing_t cryp_model_timing;
+
+extern cryp_model_stats_t  cryp_model_stats;
+
+/* power-on state of the peripheral and of the DMA streams, counters cleared */
+void cryp_model_reset(void);
+
+/*
+ * let the DMA streams run (the task being idle) until both are done, or
+ * for at most max_cycles. Returns true if a stream is still enabled.
+ */
+bool cryp_model_dma_run(uint64_t max_cycles);
+
+bool cryp_model_dma_active(void);
+
+/*
+ * value of the register at offset @off from the CRYP base, as the driver
+ * would read it, but without side effect, cost nor statistics (DOUT: the
+ * word at the head of the output FIFO, 0 if empty)
+ */
+uint32_t cryp_model_peek(uint32_t off);
+
+/* device state as set by CFG_DEV_MAP/CFG_DEV_UNMAP */
+bool cryp_model_mapped(void);
+
+#endif                          /* CRYP_MODEL_H */
@@ -0,0 +1,271 @@
+/*
+ * libcryp register trace replay, on the host CRYP model.
+ *
+ * Reads a capture printed by cryp_trace_print() (CONFIG_USR_DRV_CRYP_TRACE),
+ * one "stamp op reg value" hexadecimal line per entry, and replays its
+ * register accesses and DMA chunks against the CRYP model, so that the
+ * model follows the state of the traced peripheral. It then reports:
+ *
+ *  - the redundant writes: CR, DMACR and IMSCR writes of the value the
+ *    register already holds (and IV writes, with -d, for a capture taken
+ *    with CONFIG_USR_DRV_CRYP_TRACE_DATA). A CR write flushing the FIFOs is
+ *    never redundant. Key values are not traced and are not checked.
+ *  - the wasted SR polls: SR reads returning the same status as the
+ *    previous SR read, with no other CRYP access or DMA chunk in between.
+ *
+ * DMA chunks are run to completion by the model before the next register
+ * access. Data accesses the model can not take (DIN write to a full FIFO,
+ * DOUT read of an empty FIFO while the core is idle, e.g. after entries
+ * were lost) are skipped and counted, instead of aborting the replay.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api/libcryp.h"
+#include "cryp_regs.h"
+#include "libc/regutils.h"
+#include "libc/syscall.h"
+#include "cryp_model.h"
+
+#define REPLAY_CR       0x00
+#define REPLAY_SR       0x04
+#define REPLAY_DIN      0x08
+#define REPLAY_DOUT     0x0c
+#define REPLAY_DMACR    0x10
+#define REPLAY_IMSCR    0x14
+#define REPLAY_IV       0x40
+#define REPLAY_END      0x90
+
+/* DMA chunks are at most CRYP_DMA_MAX_SIZE bytes */
+static uint32_t replay_dma_buf[2][(CRYP_DMA_MAX_SIZE + 3) / 4];
+
+static int dma_in_desc;
+static int dma_out_desc;
+
+static struct {
+    unsigned long entries;
+    unsigned long lost;
+    unsigned long malformed;
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long dma_in;
+    unsigned long dma_out;
+    unsigned long redundant_cr;
+    unsigned long redundant_dmacr;
+    unsigned long redundant_imscr;
+    unsigned long redundant_iv;
+    unsigned long sr_polls;
+    unsigned long sr_wasted;
+    unsigned long skipped;
+    unsigned long dma_stalled;
+} replay;
+
+static bool replay_verbose;
+static bool replay_data;
+
+/* status of the last SR read, if it is the last access */
+static bool     replay_sr_valid;
+static uint32_t replay_sr;
+
+static bool replay_dma_pending;
+
+static void replay_dma_chunk(bool in, uint32_t size)
+{
+    dma_t cfg;
+
+    if ((size == 0) || (size > CRYP_DMA_MAX_SIZE) || (size % 4)) {
+        replay.malformed++;
+        return;
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    if (in) {
+        cfg.in_addr = (physaddr_t) replay_dma_buf[0];
+        cfg.size = (uint16_t) size;
+        sys_cfg(CFG_DMA_RECONF, &cfg, DMA_RECONF_BUFIN | DMA_RECONF_BUFSIZE, dma_in_desc);
+        replay.dma_in++;
+    } else {
+        cfg.out_addr = (physaddr_t) replay_dma_buf[1];
+        cfg.size = (uint16_t) size;
+        sys_cfg(CFG_DMA_RECONF, &cfg, DMA_RECONF_BUFOUT | DMA_RECONF_BUFSIZE, dma_out_desc);
+        replay.dma_out++;
+    }
+    replay_dma_pending = true;
+}
+
+/* the driver accesses the registers again once the chunks are done */
+static void replay_dma_flush(void)
+{
+    if (!replay_dma_pending) {
+        return;
+    }
+    replay_dma_pending = false;
+    if (cryp_model_dma_run(1000ULL * CRYP_DMA_MAX_SIZE)) {
+        /* the model is out of step with the traced peripheral */
+        sys_cfg(CFG_DMA_DISABLE, dma_in_desc);
+        sys_cfg(CFG_DMA_DISABLE, dma_out_desc);
+        replay.dma_stalled++;
+    }
+}
+
+static void replay_read(unsigned long line, uint32_t reg, uint32_t value)
+{
+    uint32_t sr = cryp_model_peek(REPLAY_SR);
+
+    replay.reads++;
+    if (reg == REPLAY_SR) {
+        replay.sr_polls++;
+        if (replay_sr_valid && (value == replay_sr)) {
+            replay.sr_wasted++;
+            if (replay_verbose) {
+                printf("line %lu: wasted SR poll (%x)\n", line, value);
+            }
+        }
+        replay_sr_valid = true;
+        replay_sr = value;
+    } else {
+        replay_sr_valid = false;
+    }
+
+    if ((reg == REPLAY_DOUT) && !(sr & (CRYP_SR_OFNE_Msk | CRYP_SR_BUSY_Msk))) {
+        replay.skipped++;
+        return;
+    }
+    cryp_model_read(REG_ADDR(CRYP_BASE + reg));
+}
+
+static void replay_write(unsigned long line, uint32_t reg, uint32_t value)
+{
+    uint32_t cur = cryp_model_peek(reg);
+    unsigned long *redundant = NULL;
+
+    replay.writes++;
+    replay_sr_valid = false;
+
+    if (reg == REPLAY_CR) {
+        if (!(value & CRYP_CR_FFLUSH_Msk) && (value == cur)) {
+            redundant = &replay.redundant_cr;
+        }
+    } else if ((reg == REPLAY_DMACR) && (value == cur)) {
+        redundant = &replay.redundant_dmacr;
+    } else if ((reg == REPLAY_IMSCR) && (value == cur)) {
+        redundant = &replay.redundant_imscr;
+    } else if (replay_data && (reg >= REPLAY_IV) && (reg < REPLAY_IV + 0x10) && (value == cur)) {
+        redundant = &replay.redundant_iv;
+    }
+    if (redundant) {
+        (*redundant)++;
+        if (replay_verbose) {
+            printf("line %lu: redundant write of %x at %x\n", line, value, reg);
+        }
+    }
+
+    if ((reg == REPLAY_DIN) && !(cryp_model_peek(REPLAY_SR) & CRYP_SR_IFNF_Msk)) {
+        replay.skipped++;
+        return;
+    }
+    cryp_model_write(REG_ADDR(CRYP_BASE + reg), value);
+}
+
+static void replay_line(unsigned long line, const char *buf)
+{
+    unsigned int stamp, op, reg, value;
+
+    if (sscanf(buf, "cryp trace: %x entries lost", &value) == 1) {
+        replay.lost += value;
+        replay_sr_valid = false;
+        return;
+    }
+    if ((sscanf(buf, "%x %x %x %x", &stamp, &op, &reg, &value) != 4) ||
+        (op > CRYP_TRACE_DMA_OUT) || (reg >= REPLAY_END) || (reg % 4)) {
+        replay.malformed++;
+        return;
+    }
+    replay.entries++;
+
+    switch (op) {
+    case CRYP_TRACE_DMA_IN:
+    case CRYP_TRACE_DMA_OUT:
+        replay_sr_valid = false;
+        replay_dma_chunk(op == CRYP_TRACE_DMA_IN, value);
+        break;
+    case CRYP_TRACE_READ:
+        replay_dma_flush();
+        replay_read(line, reg, value);
+        break;
+    default:
+        replay_dma_flush();
+        replay_write(line, reg, value);
+        break;
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("usage: %s [-d] [-v] [capture]\n"
+           "  -d  the capture holds the data and IV values (CONFIG_USR_DRV_CRYP_TRACE_DATA)\n"
+           "  -v  print each redundant write and wasted poll\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = stdin;
+    char buf[128];
+    unsigned long line = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "dvh")) != -1) {
+        switch (opt) {
+        case 'd':
+            replay_data = true;
+            break;
+        case 'v':
+            replay_verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        f = fopen(argv[optind], "r");
+        if (f == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    cryp_model_reset();
+    if (cryp_early_init(true, CRYP_MAP_AUTO, CRYP_CFG, &dma_in_desc, &dma_out_desc)) {
+        printf("FAIL: model init\n");
+        return 1;
+    }
+
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        replay_line(++line, buf);
+    }
+    replay_dma_flush();
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    printf("entries: %lu (%lu lost, %lu malformed lines)\n",
+           replay.entries, replay.lost, replay.malformed);
+    printf("accesses: %lu reads, %lu writes, DMA chunks: %lu in, %lu out\n",
+           replay.reads, replay.writes, replay.dma_in, replay.dma_out);
+    printf("redundant writes: %lu (CR %lu, DMACR %lu, IMSCR %lu",
+           replay.redundant_cr + replay.redundant_dmacr + replay.redundant_imscr +
+           replay.redundant_iv, replay.redundant_cr, replay.redundant_dmacr,
+           replay.redundant_imscr);
+    if (replay_data) {
+        printf(", IV %lu", replay.redundant_iv);
+    }
+    printf(")\n");
+    printf("SR polls: %lu, wasted: %lu\n", replay.sr_polls, replay.sr_wasted);
+    if (replay.skipped || replay.dma_stalled) {
+        printf("model out of step: %lu data accesses skipped, %lu DMA chunks not completed\n",
+               replay.skipped, replay.dma_stalled);
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * In-place operation test, on the host CRYP model.
+ *
+ * Each mode and direction is run once from a source buffer to a separate
+ * output buffer, then in place on a copy of the source, and both results
+ * are compared byte for byte. This is done through the direct access path,
+ * the DMA path, the DMA path chunked above CRYP_DMA_MAX_SIZE and the bounced
+ * DMA path (unaligned buffers, CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0). Partially
+ * overlapping buffers must be refused by both paths.
+ *
+ * The exit status is not 0 on a failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api/libcryp.h"
+#include "cryp_model.h"
+
+static const struct {
+    const char          *name;
+    enum crypto_algo     mode;
+    enum crypto_key_len  key_len;
+    unsigned int         iv_len;
+} test_modes[] = {
+    { "tdes-ecb", TDES_ECB, KEY_192, 8  },
+    { "tdes-cbc", TDES_CBC, KEY_192, 8  },
+    { "aes-ecb",  AES_ECB,  KEY_256, 16 },
+    { "aes-cbc",  AES_CBC,  KEY_256, 16 },
+    { "aes-ctr",  AES_CTR,  KEY_128, 16 },
+};
+
+#define TEST_MODES      (sizeof(test_modes) / sizeof(test_modes[0]))
+
+/* above CRYP_DMA_MAX_SIZE, and a multiple of the AES and (T)DES blocks */
+#define TEST_BIG        (CRYP_DMA_MAX_SIZE + 0x2010)
+
+enum test_path {
+    TEST_PIO,
+    TEST_DMA,
+    TEST_DMA_CHUNKED,
+    TEST_DMA_BOUNCED
+};
+
+static const char *test_path_names[] = { "direct access", "DMA", "chunked DMA", "bounced DMA" };
+
+static const uint8_t test_key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+    0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+};
+
+static const uint8_t test_iv[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0x00, 0x00, 0x00, 0x01
+};
+
+static int dma_in_desc;
+static int dma_out_desc;
+static volatile bool dma_done;
+static volatile uint32_t dma_status;
+
+/* word aligned areas, one spare word for the unaligned (bounced) runs */
+static uint32_t test_src[(TEST_BIG + 4) / 4];
+static uint32_t test_sep[(TEST_BIG + 4) / 4];
+static uint32_t test_inp[(TEST_BIG + 8) / 4];
+
+static int fails;
+
+static void test_dma_in(uint8_t irq, uint32_t status)
+{
+    (void) irq;
+    (void) status;
+}
+
+static void test_dma_out(uint8_t irq, uint32_t status)
+{
+    (void) irq;
+    dma_status = status;
+    dma_done = true;
+}
+
+static int test_do(enum test_path path, const uint8_t * in, uint8_t * out, uint32_t size)
+{
+    if (path == TEST_PIO) {
+        return cryp_do_no_dma(in, out, size);
+    }
+    dma_done = false;
+    dma_status = 0;
+    if (cryp_do_dma(in, out, size, dma_in_desc, dma_out_desc)) {
+        return -1;
+    }
+    cryp_model_dma_run(1000ULL * size + 100000);
+    return (dma_done && !(dma_status & CRYP_DMA_STATUS_ERROR)) ? 0 : -1;
+}
+
+static void test_run(uint32_t m, enum crypto_dir dir, enum test_path path, uint32_t size)
+{
+    /* the bounced runs start one byte off the word alignment */
+    uint32_t off = (path == TEST_DMA_BOUNCED) ? 1 : 0;
+    const uint8_t *src = (const uint8_t *) test_src + off;
+    uint8_t *sep = (uint8_t *) test_sep + off;
+    uint8_t *inp = (uint8_t *) test_inp + off;
+    const uint8_t *iv = (test_modes[m].mode == TDES_ECB) ||
+                        (test_modes[m].mode == AES_ECB) ? NULL : test_iv;
+
+    memset(sep, 0, size);
+    cryp_init(test_key, test_modes[m].key_len, iv, test_modes[m].iv_len, test_modes[m].mode, dir);
+    if (test_do(path, src, sep, size)) {
+        printf("FAIL: %s %s, %u bytes, separate buffers\n",
+               test_modes[m].name, test_path_names[path], size);
+        fails++;
+        return;
+    }
+
+    memcpy(inp, src, size);
+    /* guard byte: in place must not write past the buffer */
+    inp[size] = 0x5a;
+    cryp_init(test_key, test_modes[m].key_len, iv, test_modes[m].iv_len, test_modes[m].mode, dir);
+    if (test_do(path, inp, inp, size)) {
+        printf("FAIL: %s %s, %u bytes, in place\n",
+               test_modes[m].name, test_path_names[path], size);
+        fails++;
+        return;
+    }
+    if (memcmp(inp, sep, size) || (inp[size] != 0x5a)) {
+        printf("FAIL: %s %s %s, %u bytes, in place result differs\n",
+               test_modes[m].name, (dir == ENCRYPT) ? "enc" : "dec", test_path_names[path], size);
+        fails++;
+    }
+}
+
+/* partial overlaps, in both directions, are refused by both paths */
+static void test_overlaps(void)
+{
+    uint8_t *buf = (uint8_t *) test_inp;
+    enum test_path path;
+
+    cryp_init(test_key, KEY_128, test_iv, 16, AES_CBC, ENCRYPT);
+    for (path = TEST_PIO; path <= TEST_DMA; path++) {
+        if (test_do(path, buf, buf + 16, 64) != -1) {
+            printf("FAIL: %s, output overlapping the input end accepted\n", test_path_names[path]);
+            fails++;
+        }
+        if (test_do(path, buf + 16, buf, 64) != -1) {
+            printf("FAIL: %s, output overlapping the input start accepted\n", test_path_names[path]);
+            fails++;
+        }
+        if (test_do(path, buf + 4, buf, 64) != -1) {
+            printf("FAIL: %s, output one word behind the input accepted\n", test_path_names[path]);
+            fails++;
+        }
+        /* adjacent buffers do not overlap */
+        if (test_do(path, buf, buf + 64, 64) != 0) {
+            printf("FAIL: %s, adjacent buffers refused\n", test_path_names[path]);
+            fails++;
+        }
+    }
+}
+
+int main(void)
+{
+    static const uint32_t sizes[] = { 16, 64, 512, 4096 };
+    uint32_t m, d, s, i;
+    uint8_t *src = (uint8_t *) test_src;
+
+    for (i = 0; i < sizeof(test_src); i++) {
+        src[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    cryp_model_reset();
+    if (cryp_early_init(true, CRYP_MAP_AUTO, CRYP_CFG, &dma_in_desc, &dma_out_desc) ||
+        cryp_init_dma(test_dma_in, test_dma_out, dma_in_desc, dma_out_desc)) {
+        printf("FAIL: driver init\n");
+        return 1;
+    }
+
+    for (m = 0; m < TEST_MODES; m++) {
+        for (d = 0; d < 2; d++) {
+            for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                test_run(m, (enum crypto_dir) d, TEST_PIO, sizes[s]);
+                test_run(m, (enum crypto_dir) d, TEST_DMA, sizes[s]);
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+                test_run(m, (enum crypto_dir) d, TEST_DMA_BOUNCED, sizes[s]);
+#endif
+            }
+            test_run(m, (enum crypto_dir) d, TEST_DMA_CHUNKED, TEST_BIG);
+#if CONFIG_USR_DRV_CRYP_BOUNCE_SIZE > 0
+            test_run(m, (enum crypto_dir) d, TEST_DMA_BOUNCED, TEST_BIG);
+#endif
+        }
+    }
+    test_overlaps();
+
+    printf("in place: %s\n", fails ? "FAILED" : "all in place results match");
+    return fails ? 1 : 0;
+}
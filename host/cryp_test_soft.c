@@ -0,0 +1,332 @@
+/*
+ * Software/hardware equivalence test, on the host CRYP model.
+ *
+ * Needs CONFIG_USR_DRV_CRYP_SOFT ("make -C host test" also builds the
+ * library with it). Every mode, key length and direction is run through
+ * the software path (cryp_soft_do()) and the hardware path (cryp_do_no_dma()
+ * on the model), a message being split over several calls. Both outputs are
+ * compared to libcrypto, and the chaining value (CBC) or counter (CTR) left
+ * after each call is compared to the expected one, read back from the
+ * software context and from the IV registers. The 32-bit wrap of the CTR
+ * counter, where the Cryp core does not carry into the upper words, is
+ * checked against a reference built from single block encryptions. Finally
+ * a message is split over both backends of the dispatcher (cryp_auto_do()).
+ *
+ * The exit status is not 0 on a failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "api/libcryp.h"
+#include "cryp_model.h"
+
+#if CONFIG_USR_DRV_CRYP_SOFT
+
+static const struct {
+    const char          *name;
+    enum crypto_algo     mode;
+    uint32_t             block;
+    bool                 has_iv;
+} test_modes[] = {
+    { "tdes-ecb", TDES_ECB, 8,  false },
+    { "tdes-cbc", TDES_CBC, 8,  true  },
+    { "des-ecb",  DES_ECB,  8,  false },
+    { "des-cbc",  DES_CBC,  8,  true  },
+    { "aes-ecb",  AES_ECB,  16, false },
+    { "aes-cbc",  AES_CBC,  16, true  },
+    { "aes-ctr",  AES_CTR,  16, true  },
+};
+
+#define TEST_MODES      (sizeof(test_modes) / sizeof(test_modes[0]))
+
+/* a message is made of these calls, in blocks */
+static const uint32_t test_calls[] = { 1, 3, 8, 1, 19 };
+
+#define TEST_CALLS      (sizeof(test_calls) / sizeof(test_calls[0]))
+#define TEST_MAX        (32 * 16)
+
+static const uint8_t test_key[32] = {
+    0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+    0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+};
+
+static const uint8_t test_iv[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0x00, 0x00, 0x00, 0x01
+};
+
+static uint32_t test_in[TEST_MAX / 4];
+static uint32_t test_hw[TEST_MAX / 4];
+static uint8_t  test_sw[TEST_MAX];
+static uint8_t  test_ref[TEST_MAX];
+
+static int fails;
+
+static const EVP_CIPHER *test_cipher(enum crypto_algo mode, enum crypto_key_len key_len)
+{
+    switch (mode) {
+    case TDES_ECB:
+    case DES_ECB:
+        return EVP_des_ede3_ecb();
+    case TDES_CBC:
+    case DES_CBC:
+        return EVP_des_ede3_cbc();
+    case AES_ECB:
+        return (key_len == KEY_128) ? EVP_aes_128_ecb() :
+               (key_len == KEY_192) ? EVP_aes_192_ecb() : EVP_aes_256_ecb();
+    case AES_CBC:
+        return (key_len == KEY_128) ? EVP_aes_128_cbc() :
+               (key_len == KEY_192) ? EVP_aes_192_cbc() : EVP_aes_256_cbc();
+    default:
+        return (key_len == KEY_128) ? EVP_aes_128_ctr() :
+               (key_len == KEY_192) ? EVP_aes_192_ctr() : EVP_aes_256_ctr();
+    }
+}
+
+/* libcrypto result; single DES being EDE with the same key three times */
+static void test_reference(enum crypto_algo mode, enum crypto_key_len key_len,
+                           enum crypto_dir dir, const uint8_t * iv,
+                           const uint8_t * in, uint8_t * out, uint32_t size)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    uint8_t k[32];
+    int len;
+
+    memcpy(k, test_key, 32);
+    if ((mode == DES_ECB) || (mode == DES_CBC)) {
+        memcpy(k + 8, test_key, 8);
+        memcpy(k + 16, test_key, 8);
+    }
+    EVP_CipherInit_ex(ctx, test_cipher(mode, key_len), NULL, k, iv, (dir == ENCRYPT) ? 1 : 0);
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    EVP_CipherUpdate(ctx, out, &len, in, (int) size);
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+/* counter after @blocks blocks: only the last word is incremented */
+static void test_ctr_add(const uint8_t * iv, uint32_t blocks, uint8_t * ctr)
+{
+    uint32_t c = ((uint32_t) iv[12] << 24) | ((uint32_t) iv[13] << 16) |
+                 ((uint32_t) iv[14] << 8) | iv[15];
+
+    c += blocks;
+    memcpy(ctr, iv, 12);
+    ctr[12] = (uint8_t)(c >> 24);
+    ctr[13] = (uint8_t)(c >> 16);
+    ctr[14] = (uint8_t)(c >> 8);
+    ctr[15] = (uint8_t) c;
+}
+
+/* chaining value expected once @done bytes of the message are processed */
+static void test_chaining(uint32_t m, enum crypto_dir dir, const uint8_t * iv, uint32_t done,
+                          uint8_t * expect)
+{
+    uint32_t block = test_modes[m].block;
+
+    if (test_modes[m].mode == AES_CTR) {
+        test_ctr_add(iv, done / 16, expect);
+    } else if (dir == ENCRYPT) {
+        memcpy(expect, test_ref + done - block, block);
+    } else {
+        memcpy(expect, (const uint8_t *) test_in + done - block, block);
+    }
+}
+
+static void test_check(const char *what, uint32_t m, enum crypto_key_len key_len,
+                       enum crypto_dir dir, uint32_t call, const uint8_t * got,
+                       const uint8_t * expect, uint32_t len)
+{
+    if (memcmp(got, expect, len)) {
+        printf("FAIL: %s %u %s, call %u: %s differs\n", test_modes[m].name,
+               (test_modes[m].block == 16) ? 128 + 64 * key_len : 192,
+               (dir == ENCRYPT) ? "enc" : "dec", call, what);
+        fails++;
+    }
+}
+
+static void test_run(uint32_t m, enum crypto_key_len key_len, enum crypto_dir dir,
+                     const uint8_t * iv)
+{
+    enum crypto_algo mode = test_modes[m].mode;
+    uint32_t block = test_modes[m].block;
+    const uint8_t *ivp = test_modes[m].has_iv ? iv : NULL;
+    unsigned int iv_len = (block == 8) ? 8 : 16;
+    const uint8_t *in = (const uint8_t *) test_in;
+    uint8_t *hw = (uint8_t *) test_hw;
+    uint8_t expect[16], sw_iv[16], hw_iv[16];
+    cryp_soft_t soft;
+    uint32_t done = 0;
+    uint32_t c, len;
+
+    test_reference(mode, key_len, dir, iv, in, test_ref, TEST_MAX / (16 / block));
+
+    if (cryp_soft_init(&soft, test_key, key_len, ivp, iv_len, mode, dir)) {
+        printf("FAIL: %s, software init\n", test_modes[m].name);
+        fails++;
+        return;
+    }
+    cryp_init(test_key, key_len, ivp, iv_len, mode, dir);
+
+    for (c = 0; c < TEST_CALLS; c++) {
+        len = test_calls[c] * block;
+        if (cryp_soft_do(&soft, in + done, test_sw + done, len) ||
+            cryp_do_no_dma(in + done, hw + done, len)) {
+            printf("FAIL: %s, call %u refused\n", test_modes[m].name, c);
+            fails++;
+            break;
+        }
+        done += len;
+        test_check("software output", m, key_len, dir, c, test_sw, test_ref, done);
+        test_check("hardware output", m, key_len, dir, c, hw, test_ref, done);
+        if (!test_modes[m].has_iv) {
+            continue;
+        }
+        test_chaining(m, dir, iv, done, expect);
+        cryp_soft_get_iv(&soft, sw_iv, iv_len);
+        cryp_get_iv(hw_iv, iv_len);
+        test_check("software chaining value", m, key_len, dir, c, sw_iv, expect, iv_len);
+        test_check("hardware chaining value", m, key_len, dir, c, hw_iv, expect, iv_len);
+    }
+    cryp_soft_wipe(&soft);
+}
+
+/*
+ * counter wrap: the reference keystream is made of single block encryptions
+ * of the counter blocks, libcrypto CTR carrying into the upper words
+ */
+static void test_ctr_wrap(enum crypto_key_len key_len, enum crypto_dir dir)
+{
+    static const uint32_t calls[] = { 1, 2, 3 };
+    static const uint8_t iv[16] = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xff, 0xff, 0xff, 0xfd
+    };
+    const uint8_t *in = (const uint8_t *) test_in;
+    uint8_t *hw = (uint8_t *) test_hw;
+    uint8_t ctr[16], ks[16], sw_iv[16], hw_iv[16];
+    uint32_t m = TEST_MODES - 1;
+    cryp_soft_t soft;
+    uint32_t done = 0;
+    uint32_t c, i;
+
+    for (i = 0; i < 6; i++) {
+        test_ctr_add(iv, i, ctr);
+        test_reference(AES_ECB, key_len, ENCRYPT, NULL, ctr, ks, 16);
+        for (c = 0; c < 16; c++) {
+            test_ref[16 * i + c] = in[16 * i + c] ^ ks[c];
+        }
+    }
+
+    cryp_soft_init(&soft, test_key, key_len, iv, 16, AES_CTR, dir);
+    cryp_init(test_key, key_len, iv, 16, AES_CTR, dir);
+    for (c = 0; c < sizeof(calls) / sizeof(calls[0]); c++) {
+        cryp_soft_do(&soft, in + done, test_sw + done, 16 * calls[c]);
+        cryp_do_no_dma(in + done, hw + done, 16 * calls[c]);
+        done += 16 * calls[c];
+        test_check("wrapped software output", m, key_len, dir, c, test_sw, test_ref, done);
+        test_check("wrapped hardware output", m, key_len, dir, c, hw, test_ref, done);
+        test_ctr_add(iv, done / 16, ctr);
+        cryp_soft_get_iv(&soft, sw_iv, 16);
+        cryp_get_iv(hw_iv, 16);
+        test_check("wrapped software counter", m, key_len, dir, c, sw_iv, ctr, 16);
+        test_check("wrapped hardware counter", m, key_len, dir, c, hw_iv, ctr, 16);
+    }
+    cryp_soft_wipe(&soft);
+}
+
+/*
+ * dispatcher: the engine is held by the test for every other request, which
+ * then goes to software, the chaining value carrying over the backends
+ */
+static void test_auto(uint32_t m, enum crypto_key_len key_len, enum crypto_dir dir)
+{
+    const uint8_t *in = (const uint8_t *) test_in;
+    uint32_t block = test_modes[m].block;
+    unsigned int iv_len = (block == 8) ? 8 : 16;
+    uint8_t expect[16];
+    cryp_auto_t ctx;
+    uint32_t done = 0;
+    uint32_t c, len;
+    bool held;
+
+    test_reference(test_modes[m].mode, key_len, dir, test_iv, in, test_ref, TEST_MAX / (16 / block));
+    if (cryp_auto_init(&ctx, test_key, key_len, test_modes[m].has_iv ? test_iv : NULL, iv_len,
+                       test_modes[m].mode, dir)) {
+        printf("FAIL: %s, dispatcher init\n", test_modes[m].name);
+        fails++;
+        return;
+    }
+    for (c = 0; c < TEST_CALLS; c++) {
+        len = test_calls[c] * block;
+        held = (c % 2) == 0;
+        if (held && cryp_claim(CRYP_PRIO_URGENT)) {
+            printf("FAIL: engine not released by the dispatcher\n");
+            fails++;
+            held = false;
+        }
+        if (cryp_auto_do(&ctx, in + done, test_sw + done, len) ||
+            (ctx.last != (held ? CRYP_BACKEND_SOFT : CRYP_BACKEND_HW))) {
+            printf("FAIL: %s, dispatcher call %u refused or misrouted\n", test_modes[m].name, c);
+            fails++;
+        }
+        if (held) {
+            cryp_release();
+        }
+        done += len;
+        test_check("dispatcher output", m, key_len, dir, c, test_sw, test_ref, done);
+        if (test_modes[m].has_iv) {
+            test_chaining(m, dir, test_iv, done, expect);
+            test_check("dispatcher chaining value", m, key_len, dir, c, ctx.iv, expect, iv_len);
+        }
+    }
+    cryp_auto_release(&ctx);
+}
+
+int main(void)
+{
+    uint8_t *in = (uint8_t *) test_in;
+    int dma_in_desc, dma_out_desc;
+    uint32_t m, d, k, i;
+
+    for (i = 0; i < TEST_MAX; i++) {
+        in[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+
+    cryp_model_reset();
+    if (cryp_early_init(false, CRYP_MAP_AUTO, CRYP_CFG, &dma_in_desc, &dma_out_desc)) {
+        printf("FAIL: driver init\n");
+        return 1;
+    }
+
+    for (m = 0; m < TEST_MODES; m++) {
+        for (d = 0; d < 2; d++) {
+            if (test_modes[m].block == 8) {
+                test_run(m, KEY_192, (enum crypto_dir) d, test_iv);
+                test_auto(m, KEY_192, (enum crypto_dir) d);
+                continue;
+            }
+            for (k = KEY_128; k <= KEY_256; k++) {
+                test_run(m, (enum crypto_key_len) k, (enum crypto_dir) d, test_iv);
+                test_auto(m, (enum crypto_key_len) k, (enum crypto_dir) d);
+            }
+        }
+    }
+    for (d = 0; d < 2; d++) {
+        for (k = KEY_128; k <= KEY_256; k++) {
+            test_ctr_wrap((enum crypto_key_len) k, (enum crypto_dir) d);
+        }
+    }
+
+    printf("soft: %s\n", fails ? "FAILED" : "software and hardware paths match libcrypto");
+    return fails ? 1 : 0;
+}
+
+#else
+
+int main(void)
+{
+    printf("soft: skipped, CONFIG_USR_DRV_CRYP_SOFT not set\n");
+    return 0;
+}
+
+#endif
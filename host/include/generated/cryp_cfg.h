@@ -0,0 +1,8 @@
+#ifndef HOST_GENERATED_CRYP_CFG_H
+#define HOST_GENERATED_CRYP_CFG_H
+
+#include "generated/cryp_user.h"
+
+static const struct user_driver_device_infos cryp_cfg_dev_infos = { 0x50060000, 0x400 };
+
+#endif                          /* HOST_GENERATED_CRYP_CFG_H */
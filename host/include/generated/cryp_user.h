@@ -0,0 +1,21 @@
+#ifndef HOST_GENERATED_CRYP_USER_H
+#define HOST_GENERATED_CRYP_USER_H
+
+/* Host build of libcryp: the STM32F439 CRYP layout the SDK would generate */
+#include "libc/types.h"
+
+#define CRYP_USER_BASE              0x50060000
+#define CRYP_USER_DMA_CTRL          2
+#define CRYP_USER_DMA_IN_CHANNEL    2
+#define CRYP_USER_DMA_OUT_CHANNEL   2
+#define CRYP_USER_DMA_IN_STREAM     6
+#define CRYP_USER_DMA_OUT_STREAM    5
+
+struct user_driver_device_infos {
+    physaddr_t address;
+    uint32_t   size;
+};
+
+static const struct user_driver_device_infos cryp_user_dev_infos = { 0x50060000, 0x400 };
+
+#endif                          /* HOST_GENERATED_CRYP_USER_H */
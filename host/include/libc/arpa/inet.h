@@ -0,0 +1,6 @@
+#ifndef HOST_LIBC_ARPA_INET_H
+#define HOST_LIBC_ARPA_INET_H
+
+#include <arpa/inet.h>
+
+#endif                          /* HOST_LIBC_ARPA_INET_H */
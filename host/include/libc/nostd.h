@@ -0,0 +1,6 @@
+#ifndef HOST_LIBC_NOSTD_H
+#define HOST_LIBC_NOSTD_H
+
+/* nothing of the SDK non-standard helpers is used by libcryp */
+
+#endif                          /* HOST_LIBC_NOSTD_H */
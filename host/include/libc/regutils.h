@@ -0,0 +1,54 @@
+#ifndef HOST_LIBC_REGUTILS_H
+#define HOST_LIBC_REGUTILS_H
+
+/*
+ * Host build of libcryp: the SDK register accessors, every access being
+ * routed to the CRYP model (see host/cryp_model.c).
+ */
+#include "libc/types.h"
+
+#define REG_ADDR(addr)  ((volatile uint32_t *)(uintptr_t)(addr))
+
+uint32_t cryp_model_read(volatile uint32_t * reg);
+
+void cryp_model_write(volatile uint32_t * reg, uint32_t value);
+
+static inline uint32_t read_reg_value(volatile uint32_t * reg)
+{
+    return cryp_model_read(reg);
+}
+
+static inline void write_reg_value(volatile uint32_t * reg, uint32_t value)
+{
+    cryp_model_write(reg, value);
+}
+
+static inline uint32_t get_reg_value(volatile uint32_t * reg, uint32_t mask, uint8_t pos)
+{
+    return (cryp_model_read(reg) & mask) >> pos;
+}
+
+static inline void set_reg_value(volatile uint32_t * reg, uint32_t value, uint32_t mask,
+                                 uint8_t pos)
+{
+    uint32_t tmp = cryp_model_read(reg);
+
+    tmp &= ~mask;
+    tmp |= (value << pos) & mask;
+    cryp_model_write(reg, tmp);
+}
+
+static inline void set_reg_bits(volatile uint32_t * reg, uint32_t value)
+{
+    cryp_model_write(reg, cryp_model_read(reg) | value);
+}
+
+static inline void clear_reg_bits(volatile uint32_t * reg, uint32_t value)
+{
+    cryp_model_write(reg, cryp_model_read(reg) & ~value);
+}
+
+#define get_reg(REG, FIELD)         get_reg_value(REG, FIELD##_Msk, FIELD##_Pos)
+#define set_reg(REG, VALUE, FIELD)  set_reg_value(REG, VALUE, FIELD##_Msk, FIELD##_Pos)
+
+#endif                          /* HOST_LIBC_REGUTILS_H */
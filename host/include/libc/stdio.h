@@ -0,0 +1,6 @@
+#ifndef HOST_LIBC_STDIO_H
+#define HOST_LIBC_STDIO_H
+
+#include <stdio.h>
+
+#endif                          /* HOST_LIBC_STDIO_H */
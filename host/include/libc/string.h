@@ -0,0 +1,6 @@
+#ifndef HOST_LIBC_STRING_H
+#define HOST_LIBC_STRING_H
+
+#include <string.h>
+
+#endif                          /* HOST_LIBC_STRING_H */
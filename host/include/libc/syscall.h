@@ -0,0 +1,176 @@
+#ifndef HOST_LIBC_SYSCALL_H
+#define HOST_LIBC_SYSCALL_H
+
+/*
+ * Host build of libcryp: the subset of the EwoK syscall interface used by
+ * the driver. The syscalls are implemented by the CRYP model, which also
+ * models the two CRYP DMA streams (see host/cryp_model.c).
+ */
+#include "libc/types.h"
+
+typedef enum {
+    SYS_E_DONE = 0,
+    SYS_E_INVAL,
+    SYS_E_DENIED,
+    SYS_E_BUSY
+} e_syscall_ret;
+
+typedef void (*user_dma_handler_t)(uint8_t irq, uint32_t status);
+typedef void (*user_handler_t)(uint8_t irq, uint32_t status, uint32_t data);
+
+/* DMA streams */
+typedef enum {
+    PERIPHERAL_TO_MEMORY,
+    MEMORY_TO_PERIPHERAL,
+    MEMORY_TO_MEMORY
+} dma_dir_t;
+
+typedef enum {
+    DMA_DIRECT_MODE,
+    DMA_FIFO_MODE,
+    DMA_CIRCULAR_MODE
+} dma_mode_t;
+
+typedef enum {
+    DMA_PRI_LOW,
+    DMA_PRI_MEDIUM,
+    DMA_PRI_HIGH,
+    DMA_PRI_VERY_HIGH
+} dma_prio_t;
+
+typedef enum {
+    DMA_DS_BYTE,
+    DMA_DS_HALFWORD,
+    DMA_DS_WORD
+} dma_datasize_t;
+
+typedef enum {
+    DMA_BURST_SINGLE,
+    DMA_BURST_INC4,
+    DMA_BURST_INC8,
+    DMA_BURST_INC16
+} dma_burst_t;
+
+typedef enum {
+    DMA_FLOWCTRL_DMA,
+    DMA_FLOWCTRL_DEV
+} dma_flowctrl_t;
+
+typedef struct {
+    uint8_t             dma;
+    uint8_t             stream;
+    uint8_t             channel;
+    uint16_t            size;
+    physaddr_t          in_addr;
+    dma_prio_t          in_prio;
+    physaddr_t          out_addr;
+    dma_prio_t          out_prio;
+    dma_mode_t          mode;
+    dma_dir_t           dir;
+    bool                mem_inc;
+    bool                dev_inc;
+    dma_datasize_t      datasize;
+    dma_burst_t         mem_burst;
+    dma_burst_t         dev_burst;
+    dma_flowctrl_t      flow_control;
+    user_dma_handler_t  in_handler;
+    user_dma_handler_t  out_handler;
+} dma_t;
+
+#define DMA_RECONF_HANDLERS     0x01
+#define DMA_RECONF_BUFIN        0x02
+#define DMA_RECONF_BUFOUT       0x04
+#define DMA_RECONF_BUFSIZE      0x08
+#define DMA_RECONF_MODE         0x10
+#define DMA_RECONF_PRIO         0x20
+
+/* devices */
+typedef enum {
+    DEV_MAP_AUTO,
+    DEV_MAP_VOLUNTARY
+} dev_map_mode_t;
+
+typedef enum {
+    IRQ_ISR_STANDARD,
+    IRQ_ISR_FORCE_MAINTHREAD,
+    IRQ_ISR_WITHOUT_MAINTHREAD
+} dev_irq_isr_scheduling_t;
+
+typedef enum {
+    IRQ_PH_NIL,
+    IRQ_PH_READ,
+    IRQ_PH_WRITE,
+    IRQ_PH_AND,
+    IRQ_PH_MASK
+} dev_irq_ph_instr_t;
+
+typedef struct {
+    uint8_t instr;
+    union {
+        struct {
+            uint16_t offset;
+        } read;
+        struct {
+            uint16_t offset;
+            uint32_t value;
+            uint32_t mask;
+        } write;
+        struct {
+            uint16_t offset_dest;
+            uint16_t offset_src;
+            uint16_t offset_mask;
+            uint8_t  mode;
+        } and;
+    };
+} dev_irq_ph_action_t;
+
+typedef struct {
+    uint32_t            status;
+    uint32_t            data;
+    dev_irq_ph_action_t action[10];
+} dev_irq_ph_t;
+
+typedef struct {
+    user_handler_t           handler;
+    uint8_t                  irq;
+    dev_irq_isr_scheduling_t mode;
+    dev_irq_ph_t             posthook;
+} dev_irq_info_t;
+
+typedef struct {
+    char            name[16];
+    physaddr_t      address;
+    uint32_t        size;
+    uint8_t         irq_num;
+    uint8_t         gpio_num;
+    dev_map_mode_t  map_mode;
+    dev_irq_info_t  irqs[4];
+} device_t;
+
+typedef enum {
+    INIT_DMA,
+    INIT_DEVACCESS,
+    INIT_DONE
+} e_init_type;
+
+typedef enum {
+    CFG_DMA_RECONF,
+    CFG_DMA_RELOAD,
+    CFG_DMA_DISABLE,
+    CFG_DEV_MAP,
+    CFG_DEV_UNMAP
+} e_cfg_type;
+
+typedef enum {
+    PREC_MILLI,
+    PREC_MICRO,
+    PREC_CYCLE
+} e_tick_type;
+
+e_syscall_ret sys_init(e_init_type type, ...);
+
+e_syscall_ret sys_cfg(e_cfg_type type, ...);
+
+e_syscall_ret sys_get_systick(uint64_t * val, e_tick_type type);
+
+#endif                          /* HOST_LIBC_SYSCALL_H */
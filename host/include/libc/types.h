@@ -0,0 +1,14 @@
+#ifndef HOST_LIBC_TYPES_H
+#define HOST_LIBC_TYPES_H
+
+/*
+ * Host build of libcryp: the SDK libc types, with physical addresses as
+ * wide as host pointers.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uintptr_t physaddr_t;
+
+#endif                          /* HOST_LIBC_TYPES_H */